@@ -0,0 +1,242 @@
+// lotus_bench - microbenchmarks of the registry hot paths, printed as json
+//
+// usage: lotus_bench [--threads <max>] [--entries <max>] [--seconds <per case>]
+//
+// build: c++ -std=c++17 -O2 -DNDEBUG -Iinclude bench/lotus_bench.cpp -o lotus_bench -pthread
+
+#include <lotus/lotus.hpp>
+
+#include <new>
+#include <cstddef>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+//=================
+// Allocation Counting
+
+// every allocation is counted so memory per registry entry can be measured
+static std::atomic<std::int64_t> allocated_bytes{0};
+
+void* operator new(std::size_t size) {
+    auto p = static_cast<std::size_t*>(std::malloc(size + sizeof(std::max_align_t)));
+    if (!p) throw std::bad_alloc();
+
+    *p = size;
+    allocated_bytes.fetch_add(static_cast<std::int64_t>(size), std::memory_order_relaxed);
+    return reinterpret_cast<char*>(p) + sizeof(std::max_align_t);
+}
+
+//the block handed to free is the one malloc returned in operator new, starting before the pointer given out
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#pragma GCC diagnostic ignored "-Warray-bounds"
+#endif
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+
+    auto p = reinterpret_cast<std::size_t*>(static_cast<char*>(ptr) - sizeof(std::max_align_t));
+    allocated_bytes.fetch_sub(static_cast<std::int64_t>(*p), std::memory_order_relaxed);
+    std::free(p);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
+//=================
+// Helpers
+
+using clock_type = std::chrono::steady_clock;
+using registry   = lotus::resource_registry<int>;
+
+//hashed keys in a flat index behind a spin lock
+using flat_policy = lotus::registry_policy<lotus::spin_mutex, lotus::hashed_keys, lotus::flat_index>;
+
+template<class policy>
+static void load_sync(const char*, lotus::resource_registry<int, policy>&, lotus::load_token<int, policy> token) {
+    lotus::complete(token, new int(0));
+}
+
+static void unload(int* object) {
+    delete object;
+}
+
+//same work as load_sync / unload, as a loader object the compiler can inline
+struct inline_loader {
+    template<class registry_type, class token_type>
+    void load(const char*, registry_type&, token_type token) {
+        lotus::complete(token, new int(0));
+    }
+
+    void unload(int* object) {
+        delete object;
+    }
+};
+
+static double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+static std::vector<std::string> make_names(std::size_t count) {
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (std::size_t i = 0; i < count; i++) names.push_back("resource/" + std::to_string(i));
+    return names;
+}
+
+// runs body on given number of threads until the time runs out; returns total operations per second
+template<class body_type>
+static double run_threads(unsigned int threads, double duration, body_type body) {
+    std::atomic<bool> start{false}, stop{false};
+    std::atomic<std::uint64_t> total{0};
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            while (!start.load()) std::this_thread::yield();
+
+            std::uint64_t ops = 0;
+            while (!stop.load(std::memory_order_relaxed)) ops += body(t);
+            total.fetch_add(ops);
+        });
+    }
+
+    auto begin = clock_type::now();
+    start.store(true);
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+    stop.store(true);
+    for (auto& w : workers) w.join();
+
+    return total.load() / seconds_since(begin);
+}
+
+struct json_writer {
+    bool first = true;
+
+    void result(const char* name, const char* param, std::uint64_t value, const char* unit, double result) {
+        std::printf("%s    {\"name\": \"%s\", \"%s\": %llu, \"unit\": \"%s\", \"value\": %.3f}",
+            first ? "" : ",\n", name, param, (unsigned long long)value, unit, result);
+        first = false;
+    }
+};
+
+//=================
+// Cases
+
+// repeated "get" of a loaded resource
+template<class policy = lotus::multi_threaded>
+static double bench_hit(unsigned int threads, double duration) {
+    lotus::resource_registry<int, policy> reg(load_sync<policy>, unload);
+    auto keep = lotus::get("hot", reg);
+
+    return run_threads(threads, duration, [&](unsigned int) {
+        for (int i = 0; i < 64; i++) lotus::get("hot", reg);
+        return 64;
+    });
+}
+
+// "get" of resources that were never loaded; every call runs the loader
+template<class registry_type, class... loader_args>
+static double bench_miss(double duration, loader_args... args) {
+    registry_type reg(args...);
+    auto names = make_names(1 << 20);
+
+    std::size_t next = 0;
+    return run_threads(1, duration, [&](unsigned int) {
+        for (int i = 0; i < 64; i++) {
+            lotus::get(names[next].c_str(), reg);
+            if (++next == names.size()) next = 0;
+        }
+        return 64;
+    });
+}
+
+// copying and destroying handles of a single loaded resource
+template<class policy = lotus::multi_threaded>
+static double bench_handle_churn(unsigned int threads, double duration) {
+    lotus::resource_registry<int, policy> reg(load_sync<policy>, unload);
+    auto keep = lotus::get("hot", reg);
+
+    return run_threads(threads, duration, [&](unsigned int) {
+        for (int i = 0; i < 64; i++) {
+            auto copy = keep;
+            (void)copy;
+        }
+        return 64;
+    });
+}
+
+// seconds per "reload_registry" / "unload_registry" call over given number of registered resources
+static void bench_bulk(std::size_t entries, double& reload_seconds, double& unload_seconds) {
+    registry reg(load_sync<lotus::multi_threaded>, unload);
+    auto names = make_names(entries);
+    for (auto& n : names) lotus::reg(n.c_str(), new int(0), reg);
+
+    auto start = clock_type::now();
+    lotus::reload_registry(reg);
+    reload_seconds = seconds_since(start);
+
+    start = clock_type::now();
+    lotus::unload_registry(reg);
+    unload_seconds = seconds_since(start);
+}
+
+// heap bytes per registered resource, including the key and the registry index
+static double bench_memory(std::size_t entries) {
+    auto names = make_names(entries);
+
+    //registry entries are never freed, so the registry object is leaked on purpose as well
+    auto reg = new registry(load_sync<lotus::multi_threaded>, unload);
+
+    auto before = allocated_bytes.load();
+    for (auto& n : names) lotus::reg(n.c_str(), static_cast<int*>(nullptr), *reg);
+
+    return static_cast<double>(allocated_bytes.load() - before) / entries;
+}
+
+//=================
+// Main
+
+int main(int argc, char** argv) {
+    unsigned int    max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t     max_entries = 1000000;
+    double          duration    = 0.5;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) max_threads = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--entries") && i + 1 < argc) max_entries = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) duration = std::atof(argv[++i]);
+        else {
+            std::fprintf(stderr, "usage: lotus_bench [--threads <max>] [--entries <max>] [--seconds <per case>]\n");
+            return 2;
+        }
+    }
+
+    json_writer out;
+    std::printf("{\n  \"benchmark\": \"lotus\",\n  \"results\": [\n");
+
+    for (unsigned int t = 1; t <= max_threads; t *= 2) out.result("get_hit", "threads", t, "ops/s", bench_hit(t, duration));
+    out.result("get_miss", "threads", 1, "ops/s", bench_miss<registry>(duration, load_sync<lotus::multi_threaded>, unload));
+    out.result("get_miss_inline_loader", "threads", 1, "ops/s", bench_miss<lotus::resource_registry<int, lotus::multi_threaded, inline_loader>>(duration));
+    for (unsigned int t = 1; t <= max_threads; t *= 2) out.result("handle_churn", "threads", t, "ops/s", bench_handle_churn(t, duration));
+
+    for (unsigned int t = 1; t <= max_threads; t *= 2) out.result("get_hit_flat_policy", "threads", t, "ops/s", bench_hit<flat_policy>(t, duration));
+    out.result("get_hit_single_threaded", "threads", 1, "ops/s", bench_hit<lotus::single_threaded>(1, duration));
+    out.result("handle_churn_single_threaded", "threads", 1, "ops/s", bench_handle_churn<lotus::single_threaded>(1, duration));
+
+    for (std::size_t n = 10000; n <= max_entries; n *= 10) {
+        double reload_seconds, unload_seconds;
+        bench_bulk(n, reload_seconds, unload_seconds);
+        out.result("reload_registry", "entries", n, "s", reload_seconds);
+        out.result("unload_registry", "entries", n, "s", unload_seconds);
+    }
+
+    out.result("memory_per_entry", "entries", 100000, "bytes", bench_memory(100000));
+
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
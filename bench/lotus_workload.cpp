@@ -0,0 +1,309 @@
+// lotus_workload - ycsb style workload driver for a resource_registry, printed as json
+//
+// usage: lotus_workload [options]
+//   --dist <uniform|zipf|hotspot|scan>  access distribution (zipf)
+//   --keys <n>                          distinct resources (100000)
+//   --theta <t>                         zipf skew (0.99)
+//   --hot-keys <f> --hot-ops <f>        hotspot: fraction of keys receiving fraction of ops (0.2, 0.8)
+//   --window <n> --step <n>             scan: window size and how many accesses before it moves by one key (1000, 16)
+//   --threads <n>                       client threads (4)
+//   --seconds <s>                       run time (5)
+//   --hold <n>                          handles each client keeps alive, emulating its working set (64)
+//   --latency-us <us>                   simulated load latency (100)
+//   --size <bytes>                      simulated resource size (4096)
+//   --loaders <n>                       asynchronous loader threads; 0 loads inside "get" (0)
+//   --prefetch <n>                      prefetch loads in flight at once; 0 disables the prefetcher (0)
+//   --seed <n>                          random seed (1)
+//
+// build: c++ -std=c++17 -O2 -DNDEBUG -Iinclude bench/lotus_workload.cpp -o lotus_workload -pthread
+
+#include <lotus/lotus.hpp>
+#include <lotus/stage_pool.hpp>
+#include <lotus/prefetcher.hpp>
+
+#include <cmath>
+#include <thread>
+#include <memory>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+//=================
+// Settings
+
+struct settings {
+    std::string     dist        = "zipf";
+    std::uint64_t   keys        = 100000;
+    double          theta       = 0.99;
+    double          hot_keys    = 0.2;
+    double          hot_ops     = 0.8;
+    std::uint64_t   window      = 1000;
+    std::uint64_t   step        = 16;
+    unsigned int    threads     = 4;
+    double          seconds     = 5;
+    std::size_t     hold        = 64;
+    unsigned int    latency_us  = 100;
+    std::size_t     size        = 4096;
+    unsigned int    loaders     = 0;
+    unsigned int    prefetch    = 0;
+    std::uint64_t   seed        = 1;
+};
+
+static settings config;
+
+//=================
+// Distributions
+
+// picks key indices in [0, keys)
+struct key_generator {
+    virtual ~key_generator() {}
+    virtual std::uint64_t next(std::mt19937_64& rng) = 0;
+};
+
+struct uniform_generator : key_generator {
+    std::uniform_int_distribution<std::uint64_t> dist;
+
+    uniform_generator(std::uint64_t keys) : dist(0, keys - 1) {}
+
+    std::uint64_t next(std::mt19937_64& rng) override {
+        return dist(rng);
+    }
+};
+
+// zipfian generator from "Quickly Generating Billion-Record Synthetic Databases" (Gray et al.), as used by ycsb
+// rank 0 is the most popular key
+struct zipf_generator : key_generator {
+    std::uint64_t   keys;
+    double          theta, alpha, zetan, eta;
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+
+    static double zeta(std::uint64_t n, double theta) {
+        double sum = 0;
+        for (std::uint64_t i = 1; i <= n; i++) sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+
+    zipf_generator(std::uint64_t _keys, double _theta) : keys(_keys), theta(_theta) {
+        zetan = zeta(keys, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta   = (1.0 - std::pow(2.0 / keys, 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+    }
+
+    std::uint64_t next(std::mt19937_64& rng) override {
+        double u  = unit(rng);
+        double uz = u * zetan;
+
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + std::pow(0.5, theta)) return 1;
+
+        auto rank = static_cast<std::uint64_t>(keys * std::pow(eta * u - eta + 1.0, alpha));
+        return rank < keys ? rank : keys - 1;
+    }
+};
+
+// hot_ops of accesses go uniformly to the first hot_keys of the key space, the rest to the remainder
+struct hotspot_generator : key_generator {
+    std::uint64_t   keys, hot;
+    double          hot_ops;
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+
+    hotspot_generator(std::uint64_t _keys, double hot_keys, double _hot_ops)
+        : keys(_keys), hot(std::max<std::uint64_t>(1, static_cast<std::uint64_t>(_keys * hot_keys))), hot_ops(_hot_ops) {}
+
+    std::uint64_t next(std::mt19937_64& rng) override {
+        if (hot >= keys || unit(rng) < hot_ops) return std::uniform_int_distribution<std::uint64_t>(0, hot - 1)(rng);
+        return std::uniform_int_distribution<std::uint64_t>(hot, keys - 1)(rng);
+    }
+};
+
+// uniform accesses inside a window that slides over the key space (e.g. a camera moving through a level)
+// the window position is shared by all clients
+struct scan_generator : key_generator {
+    std::uint64_t               keys, window, step;
+    std::atomic<std::uint64_t>  accesses{0};
+
+    scan_generator(std::uint64_t _keys, std::uint64_t _window, std::uint64_t _step)
+        : keys(_keys), window(std::min(_window, _keys)), step(std::max<std::uint64_t>(1, _step)) {}
+
+    std::uint64_t next(std::mt19937_64& rng) override {
+        auto start = accesses.fetch_add(1, std::memory_order_relaxed) / step;
+        auto offset = std::uniform_int_distribution<std::uint64_t>(0, window - 1)(rng);
+        return (start + offset) % keys;
+    }
+};
+
+//=================
+// Simulated Loader
+
+using resource = std::vector<char>;
+using registry = lotus::resource_registry<resource>;
+
+static lotus::stage_pool* loader_pool = nullptr;
+
+static void simulate_load(lotus::load_token<resource> token) {
+    if (token.cancelled()) return lotus::abandon(token);
+
+    //sleeping models io latency; the allocation and fill model the resident size
+    if (config.latency_us) std::this_thread::sleep_for(std::chrono::microseconds(config.latency_us));
+
+    auto object = new resource(config.size);
+    if (!object->empty()) std::memset(object->data(), 1, object->size());
+
+    lotus::complete(token, object);
+}
+
+static void load(const char*, registry&, lotus::load_token<resource> token) {
+    if (loader_pool) loader_pool->push([token] { simulate_load(token); });
+    else simulate_load(token);
+}
+
+static void unload(resource* object) {
+    delete object;
+}
+
+//=================
+// Main
+
+static bool parse(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+
+        const char* value = argv[++i];
+        if      (arg == "--dist")       config.dist       = value;
+        else if (arg == "--keys")       config.keys       = std::max<std::uint64_t>(2, std::strtoull(value, nullptr, 10));
+        else if (arg == "--theta")      config.theta      = std::atof(value);
+        else if (arg == "--hot-keys")   config.hot_keys   = std::atof(value);
+        else if (arg == "--hot-ops")    config.hot_ops    = std::atof(value);
+        else if (arg == "--window")     config.window     = std::max<std::uint64_t>(1, std::strtoull(value, nullptr, 10));
+        else if (arg == "--step")       config.step       = std::strtoull(value, nullptr, 10);
+        else if (arg == "--threads")    config.threads    = std::max(1, std::atoi(value));
+        else if (arg == "--seconds")    config.seconds    = std::atof(value);
+        else if (arg == "--hold")       config.hold       = std::strtoull(value, nullptr, 10);
+        else if (arg == "--latency-us") config.latency_us = static_cast<unsigned int>(std::atoi(value));
+        else if (arg == "--size")       config.size       = std::strtoull(value, nullptr, 10);
+        else if (arg == "--loaders")    config.loaders    = static_cast<unsigned int>(std::atoi(value));
+        else if (arg == "--prefetch")   config.prefetch   = static_cast<unsigned int>(std::atoi(value));
+        else if (arg == "--seed")       config.seed       = std::strtoull(value, nullptr, 10);
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (!parse(argc, argv)) {
+        std::fprintf(stderr, "usage: see the header of bench/lotus_workload.cpp\n");
+        return 2;
+    }
+
+    std::unique_ptr<key_generator> generator;
+    if      (config.dist == "uniform")  generator.reset(new uniform_generator(config.keys));
+    else if (config.dist == "zipf")     generator.reset(new zipf_generator(config.keys, config.theta));
+    else if (config.dist == "hotspot")  generator.reset(new hotspot_generator(config.keys, config.hot_keys, config.hot_ops));
+    else if (config.dist == "scan")     generator.reset(new scan_generator(config.keys, config.window, config.step));
+    else {
+        std::fprintf(stderr, "unknown distribution %s\n", config.dist.c_str());
+        return 2;
+    }
+
+    std::vector<std::string> names;
+    names.reserve(config.keys);
+    for (std::uint64_t i = 0; i < config.keys; i++) names.push_back("key/" + std::to_string(i));
+
+    std::unique_ptr<lotus::stage_pool> pool;
+    if (config.loaders) {
+        pool.reset(new lotus::stage_pool(config.loaders, 4096));
+        loader_pool = pool.get();
+    }
+
+    registry reg(load, unload);
+
+    std::unique_ptr<lotus::prefetcher<resource>> prefetcher;
+    if (config.prefetch) {
+        lotus::prefetch_config pc;
+        pc.max_inflight = config.prefetch;
+        prefetcher.reset(new lotus::prefetcher<resource>(reg, pc));
+    }
+
+    std::atomic<bool> start{false}, stop{false};
+    std::vector<std::vector<std::uint64_t>> latencies(config.threads);
+
+    std::vector<std::thread> clients;
+    for (unsigned int t = 0; t < config.threads; t++) {
+        clients.emplace_back([&, t] {
+            std::mt19937_64 rng(config.seed * 7919 + t);
+            std::vector<lotus::resource_handle<resource>> held(config.hold);
+            std::size_t slot = 0;
+
+            auto& samples = latencies[t];
+            samples.reserve(1 << 20);
+
+            while (!start.load()) std::this_thread::yield();
+
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto& name = names[generator->next(rng)];
+
+                //latency until the resource is usable, so asynchronous loads are included
+                auto begin = std::chrono::steady_clock::now();
+                auto handle = lotus::get(name.c_str(), reg);
+                while (handle.loading()) std::this_thread::yield();
+                auto end = std::chrono::steady_clock::now();
+
+                samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+
+                if (!held.empty()) {
+                    held[slot] = handle;
+                    slot = (slot + 1) % held.size();
+                }
+            }
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(true);
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+    stop.store(true);
+    for (auto& c : clients) c.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::vector<std::uint64_t> all;
+    for (auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+
+    auto percentile = [&](double q) -> unsigned long long {
+        if (all.empty()) return 0;
+        return all[std::min(all.size() - 1, static_cast<std::size_t>(q * all.size()))];
+    };
+
+    using S = lotus::registry_stats;
+    auto s = lotus::stats(reg);
+
+    std::printf("{\n");
+    std::printf("  \"dist\": \"%s\", \"keys\": %llu, \"threads\": %u, \"hold\": %zu,\n",
+        config.dist.c_str(), (unsigned long long)config.keys, config.threads, config.hold);
+    std::printf("  \"latency_us\": %u, \"size\": %zu, \"loaders\": %u,\n", config.latency_us, config.size, config.loaders);
+    std::printf("  \"ops\": %zu, \"throughput\": %.1f,\n", all.size(), all.size() / elapsed);
+    std::printf("  \"get_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu},\n",
+        percentile(0.5), percentile(0.99), percentile(0.999), all.empty() ? 0ull : (unsigned long long)all.back());
+    std::printf("  \"hits\": %llu, \"misses\": %llu, \"loads\": %llu, \"unloads\": %llu, \"cancellations\": %llu",
+        (unsigned long long)s.counters[S::hits], (unsigned long long)s.counters[S::misses],
+        (unsigned long long)s.counters[S::loads], (unsigned long long)s.counters[S::unloads],
+        (unsigned long long)s.counters[S::cancellations]);
+
+    if (prefetcher) {
+        auto p = prefetcher->stats();
+        std::printf(",\n  \"prefetch\": {\"issued\": %llu, \"hits\": %llu, \"wasted\": %llu, \"dropped\": %llu, \"hit_rate\": %.3f}",
+            (unsigned long long)p.issued, (unsigned long long)p.hits, (unsigned long long)p.wasted,
+            (unsigned long long)p.dropped, p.hit_rate());
+    }
+    std::printf("\n}\n");
+
+    //the prefetcher's worker gets from the registry, so it stops before the loader pool
+    prefetcher.reset();
+
+    //handles are gone, but asynchronous loads may still be queued
+    pool.reset();
+    return 0;
+}
@@ -0,0 +1,437 @@
+#pragma once
+
+#include "stage_pool.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include <cerrno>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+
+//define LOTUS_NO_IO_URING to always use the thread pool backend
+#if defined(__linux__) && !defined(LOTUS_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#define LOTUS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#endif
+
+//=================
+// Forwards
+
+namespace lotus {
+    // asynchronous whole-file reads for loaders
+    // uses a single io_uring thread with batched submissions when the kernel allows it,
+    // otherwise a pool of threads doing blocking preads; a ring failing later hands its reads over to such a pool
+    struct file_reader;
+
+    // receives file contents and 0, or empty bytes and errno value
+    // called on the reader's thread; keep it short or hand the work over to another pool
+    using read_callback = std::function<void(std::vector<unsigned char>&&, int)>;
+
+    struct file_reader_config {
+        unsigned int    queue_depth         = 256;  //reads in flight at once (io_uring)
+        unsigned int    fallback_threads    = 4;    //blocking readers (thread pool backend)
+        std::size_t     fallback_queue      = 1024;
+        bool            force_fallback      = false;
+    };
+}
+
+//=================
+// File Reader
+
+struct lotus::file_reader {
+private:
+    struct request {
+        std::string                 path;
+        read_callback               callback;
+        std::vector<unsigned char>  bytes;
+        std::size_t                 done = 0;
+        int                         fd   = -1;
+#if !defined(_WIN32)
+        iovec                       iov;
+#endif
+    };
+
+    //reads the whole file with blocking calls
+    static int read_blocking(const std::string& path, std::vector<unsigned char>& bytes) {
+#if defined(_WIN32)
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) return ENOENT;
+
+        bytes.resize(static_cast<std::size_t>(file.tellg()));
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char*>(bytes.data()), bytes.size())) return EIO;
+        return 0;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return errno;
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            int err = errno;
+            ::close(fd);
+            return err;
+        }
+
+        bytes.resize(static_cast<std::size_t>(st.st_size));
+
+        std::size_t done = 0;
+        while (done < bytes.size()) {
+            auto n = ::pread(fd, bytes.data() + done, bytes.size() - done, static_cast<off_t>(done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                int err = n < 0 ? errno : EIO;
+                ::close(fd);
+                return err;
+            }
+            done += static_cast<std::size_t>(n);
+        }
+
+        ::close(fd);
+        return 0;
+#endif
+    }
+
+    //queues a blocking read on a pool
+    static void read_on(lotus::stage_pool& pool, std::string path, read_callback callback) {
+        auto shared_callback = std::make_shared<read_callback>(std::move(callback));
+        pool.push([path, shared_callback] {
+            std::vector<unsigned char> bytes;
+            int err = read_blocking(path, bytes);
+            if (err) bytes.clear();
+            (*shared_callback)(std::move(bytes), err);
+        });
+    }
+
+    file_reader_config                  config;
+    std::unique_ptr<lotus::stage_pool>  fallback;
+
+#if defined(LOTUS_IO_URING)
+    //user_data of the eventfd poll used to wake the ring thread
+    static constexpr __u64 wake_tag = 0;
+
+    int                             ring_fd  = -1;
+    int                             wake_fd  = -1;
+    unsigned int                    depth    = 0;
+    unsigned int                    inflight = 0;
+    unsigned int                    local_tail = 0;    //sqes filled but not yet published to the kernel
+
+    void*                           sq_map   = nullptr;
+    void*                           cq_map   = nullptr;
+    std::size_t                     sq_size  = 0;
+    std::size_t                     cq_size  = 0;
+    io_uring_sqe*                   sqes     = nullptr;
+    std::size_t                     sqes_size = 0;
+
+    unsigned int*                   sq_head;
+    unsigned int*                   sq_tail;
+    unsigned int*                   sq_mask;
+    unsigned int*                   sq_array;
+    unsigned int*                   cq_head;
+    unsigned int*                   cq_tail;
+    unsigned int*                   cq_mask;
+    io_uring_cqe*                   cqes;
+
+    std::mutex                      pending_mutex;
+    std::deque<request*>            pending;
+    bool                            stopping = false;
+    std::thread                     ring_thread;
+
+    std::unordered_set<request*>    active;     //requests with a read queued in the ring; ring thread only
+    std::vector<request*>           orphans;    //requests whose buffers the kernel may still write; freed at teardown
+    std::unique_ptr<lotus::stage_pool> rescue;  //takes over reads once the ring fails; set before broken
+    std::atomic<bool>               broken{false};
+
+    bool setup_ring(unsigned int entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0) return false;
+
+        depth   = params.sq_entries;
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_map) sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+
+        sq_map = ::mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_map == MAP_FAILED) return sq_map = nullptr, false;
+
+        if (single_map) cq_map = sq_map;
+        else {
+            cq_map = ::mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+            if (cq_map == MAP_FAILED) return cq_map = nullptr, false;
+        }
+
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        auto sqes_map = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sqes_map == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(sqes_map);
+
+        auto sq = static_cast<char*>(sq_map);
+        sq_head  = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+        sq_tail  = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+        sq_mask  = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+
+        auto cq = static_cast<char*>(cq_map);
+        cq_head  = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+        cq_tail  = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+        cq_mask  = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+        cqes     = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        local_tail = *sq_tail;
+
+        wake_fd = ::eventfd(0, EFD_CLOEXEC);
+        return wake_fd >= 0;
+    }
+
+    void teardown_ring() {
+        if (sqes)                       ::munmap(sqes, sqes_size);
+        if (cq_map && cq_map != sq_map) ::munmap(cq_map, cq_size);
+        if (sq_map)                     ::munmap(sq_map, sq_size);
+        if (wake_fd >= 0)               ::close(wake_fd);
+        if (ring_fd >= 0)               ::close(ring_fd);
+
+        //closing the ring cancels the reads still targeting orphaned buffers
+        for (auto req : orphans) {
+            if (req->fd >= 0) ::close(req->fd);
+            delete req;
+        }
+        orphans.clear();
+
+        sqes = nullptr;
+        sq_map = cq_map = nullptr;
+        ring_fd = wake_fd = -1;
+    }
+
+    //only the ring thread touches the submission queue
+    //run_ring reserves a slot for every sqe it queues, so this never runs out
+    io_uring_sqe* next_sqe() {
+        unsigned int index = local_tail++ & *sq_mask;
+        sq_array[index] = index;
+
+        auto sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    void queue_wake_poll() {
+        auto sqe = next_sqe();
+        sqe->opcode      = IORING_OP_POLL_ADD;
+        sqe->fd          = wake_fd;
+        sqe->poll_events = POLLIN;
+        sqe->user_data   = wake_tag;
+    }
+
+    void queue_read(request* req) {
+        req->iov.iov_base = req->bytes.data() + req->done;
+        req->iov.iov_len  = req->bytes.size() - req->done;
+
+        auto sqe = next_sqe();
+        sqe->opcode    = IORING_OP_READV;
+        sqe->fd        = req->fd;
+        sqe->addr      = reinterpret_cast<__u64>(&req->iov);
+        sqe->len       = 1;
+        sqe->off       = req->done;
+        sqe->user_data = reinterpret_cast<__u64>(req);
+        inflight++;
+        active.insert(req);
+    }
+
+    void finish(request* req, int err) {
+        active.erase(req);
+        if (req->fd >= 0) ::close(req->fd);
+        if (err) req->bytes.clear();
+
+        req->callback(std::move(req->bytes), err);
+        delete req;
+    }
+
+    //opens the file and queues its first read; returns false when no read was queued
+    bool start(request* req) {
+        req->fd = ::open(req->path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (req->fd < 0) return finish(req, errno), false;
+
+        struct stat st;
+        if (::fstat(req->fd, &st) != 0) return finish(req, errno), false;
+
+        req->bytes.resize(static_cast<std::size_t>(st.st_size));
+        if (req->bytes.empty()) return finish(req, 0), false;
+
+        queue_read(req);
+        return true;
+    }
+
+    void reap(bool& rearm_wake) {
+        unsigned int head = *cq_head;
+
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            auto& cqe = cqes[head & *cq_mask];
+            head++;
+
+            if (cqe.user_data == wake_tag) {
+                eventfd_t value;
+                ::eventfd_read(wake_fd, &value);
+                rearm_wake = true;
+                continue;
+            }
+
+            auto req = reinterpret_cast<request*>(cqe.user_data);
+            inflight--;
+
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN) queue_read(req);
+            else if (cqe.res < 0) finish(req, -cqe.res);
+            else if (cqe.res == 0) finish(req, EIO);
+            else {
+                //short reads are resumed where they stopped
+                req->done += static_cast<std::size_t>(cqe.res);
+                if (req->done < req->bytes.size()) queue_read(req);
+                else finish(req, 0);
+            }
+        }
+
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    void run_ring() {
+        bool rearm_wake = true;
+
+        for (;;) {
+            if (rearm_wake) {
+                queue_wake_poll();
+                rearm_wake = false;
+            }
+
+            //one slot stays reserved for the wake poll
+            std::unique_lock<std::mutex> lock(pending_mutex);
+            bool stop = stopping && pending.empty() && inflight == 0;
+            while (!pending.empty() && inflight + 1 < depth) {
+                auto req = pending.front();
+                pending.pop_front();
+                lock.unlock();
+                start(req);
+                lock.lock();
+            }
+            lock.unlock();
+
+            if (stop) return;
+
+            //submits the whole batch and sleeps until at least one completion arrives
+            __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+            unsigned int to_submit = local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            auto res = ::syscall(__NR_io_uring_enter, ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (res < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) return fail_ring();
+
+            reap(rearm_wake);
+        }
+    }
+
+    //the ring can't be entered anymore: reads already completed are delivered, every other queued or submitted
+    //read is done again by a blocking pool, which also takes all later reads
+    void fail_ring() {
+        bool rearm_wake = false;
+        reap(rearm_wake);
+
+        rescue.reset(new lotus::stage_pool(config.fallback_threads ? config.fallback_threads : 1, config.fallback_queue));
+
+        std::unique_lock<std::mutex> lock(pending_mutex);
+        broken = true;
+        std::deque<request*> queued;
+        queued.swap(pending);
+        lock.unlock();
+
+        for (auto req : active) {
+            read_on(*rescue, req->path, std::move(req->callback));
+            orphans.push_back(req);
+        }
+        active.clear();
+        inflight = 0;
+
+        for (auto req : queued) {
+            read_on(*rescue, std::move(req->path), std::move(req->callback));
+            delete req;
+        }
+    }
+
+    void wake() {
+        ::eventfd_write(wake_fd, 1);
+    }
+#endif
+
+public:
+    file_reader(const file_reader_config& _config = {}) : config(_config) {
+#if defined(LOTUS_IO_URING)
+        if (!config.force_fallback && setup_ring(config.queue_depth ? config.queue_depth : 1)) {
+            ring_thread = std::thread([this] { run_ring(); });
+            return;
+        }
+        teardown_ring();
+#endif
+        fallback.reset(new lotus::stage_pool(config.fallback_threads, config.fallback_queue));
+    }
+
+    file_reader(const file_reader&) = delete;
+    file_reader& operator=(const file_reader&) = delete;
+
+    // finishes queued reads before returning
+    ~file_reader() {
+#if defined(LOTUS_IO_URING)
+        if (ring_thread.joinable()) {
+            std::unique_lock<std::mutex> lock(pending_mutex);
+            stopping = true;
+            lock.unlock();
+
+            wake();
+            ring_thread.join();
+            teardown_ring();
+        }
+#endif
+    }
+
+    // returns whether reads go through io_uring
+    bool uses_io_uring() const {
+#if defined(LOTUS_IO_URING)
+        if (broken) return false;
+#endif
+        return !fallback;
+    }
+
+    // queues read of the whole file; the callback is invoked once it finishes
+    // thread safe
+    void read(std::string path, read_callback callback) {
+        if (fallback) return read_on(*fallback, std::move(path), std::move(callback));
+
+#if defined(LOTUS_IO_URING)
+        std::unique_lock<std::mutex> lock(pending_mutex);
+        if (broken) {
+            lock.unlock();
+            return read_on(*rescue, std::move(path), std::move(callback));
+        }
+
+        auto req = new request;
+        req->path     = std::move(path);
+        req->callback = std::move(callback);
+        pending.push_back(req);
+        lock.unlock();
+
+        wake();
+#endif
+    }
+};
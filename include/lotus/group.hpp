@@ -0,0 +1,173 @@
+#pragma once
+
+#include "lotus.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+//=================
+// Forwards
+
+namespace lotus {
+    // progress of the loads requested by a group
+    struct group_progress {
+        std::size_t     requested;  //members requested so far
+        std::size_t     loaded;     //members published
+        std::size_t     failed;     //members whose load was abandoned or cancelled
+        std::uint64_t   bytes;      //sum of sizes reported by "complete" for loaded members
+
+        // returns whether every requested member finished loading
+        bool done() const {
+            return loaded + failed == requested;
+        }
+    };
+
+    // named set of resources (a level, a tenant, a bundle) requested as one batch and released together
+    //
+    // the group holds a handle to every member, so members stay loaded while they belong to the group;
+    // releasing the group drops those handles in time proportional to the group size, never scanning the registry
+    // a resource may belong to many groups; it unloads once no group nor other handle references it
+    //
+    // not thread safe; progress may be read while member loads finish on other threads
+    template<class resource_type, class policy, class loader_type>
+    struct resource_group;
+}
+
+//=================
+// Resource Group
+
+template<class resource_type, class policy, class loader_type>
+struct lotus::resource_group {
+private:
+    using handle   = lotus::resource_handle<resource_type, policy, loader_type>;
+    using registry = lotus::resource_registry<resource_type, policy, loader_type>;
+    using shared   = typename handle::shared;
+    using states   = typename handle::states;
+    using token    = lotus::load_token<resource_type, policy, loader_type>;
+
+    template<class T>
+    using atomic = typename policy::template atomic<T>;
+
+    //outlives the group while loads it waits for are pending
+    struct counters {
+        atomic<std::size_t>     loaded{0};
+        atomic<std::size_t>     failed{0};
+        atomic<std::uint64_t>   bytes{0};
+    };
+
+    struct waiter {
+        std::shared_ptr<counters>   counts;
+        shared*                     shr;
+    };
+
+    std::string                 group_name;
+    registry&                   reg;
+    std::vector<handle>         members;
+    std::shared_ptr<counters>   counts = std::make_shared<counters>();
+
+    //called by the registry once a member's pending load finishes
+    static void ready(void* context, bool published) {
+        auto w = static_cast<waiter*>(context);
+
+        if (published) {
+            //hooks run outside of the mutex, and a reload may already be replacing the object
+            auto lock = w->shr->registry->acquire(lock_op::inspect);
+            auto bytes = w->shr->bytes;
+            lock.unlock();
+
+            w->counts->bytes.fetch_add(bytes);
+            w->counts->loaded.fetch_add(1);
+        }
+        else w->counts->failed.fetch_add(1);
+
+        delete w;
+    }
+
+    static const char* c_str(const char* name) { return name; }
+    static const char* c_str(const std::string& name) { return name.c_str(); }
+
+public:
+    resource_group(const char* name, registry& _reg) : group_name(name), reg(_reg) {}
+
+    resource_group(const resource_group&) = delete;
+    resource_group& operator=(const resource_group&) = delete;
+
+    // requests all given resources at once: the registry mutex is taken a single time for the whole batch,
+    // then the loader is called for every member that isn't loaded or loading yet
+    template<class name_list>
+    void request(const name_list& names) {
+        for (auto& name : names) reg.notify(registry_event::get, c_str(name));
+
+        std::vector<std::pair<const char*, token>> to_load;
+        std::size_t hits = 0;
+
+        auto lock = reg.acquire(lock_op::get);
+
+        for (auto& name : names) {
+            auto shr = reg.find_or_create_shared(c_str(name));
+            shr->accesses++;
+            reg.unlink_idle(shr);
+            members.push_back(handle{shr});
+
+            auto state = shr->state.load();
+            if (state == states::loaded) {
+                counts->bytes.fetch_add(shr->bytes);
+                counts->loaded.fetch_add(1);
+                hits++;
+                continue;
+            }
+
+            if (reg.needs_load(shr)) to_load.push_back({shr->name.c_str(), reg.begin_load(shr, shr->name.c_str())});
+            else if (state == states::failed) {
+                counts->failed.fetch_add(1);
+                continue;
+            }
+
+            reg.links_of(shr).waiters.push_back({&ready, new waiter{counts, shr}});
+        }
+
+        lock.unlock();
+
+        //hooks run outside of the mutex once the members hold their references, as in "get"
+        for (auto& name : names) reg.accessed(c_str(name));
+
+        reg.stats.add(registry_stats::hits, hits);
+        reg.stats.add(registry_stats::misses, to_load.size());
+
+        for (auto& l : to_load) {
+            LOTUS_TRACE_SPAN("load callback", l.first);
+            reg.callbacks.load(l.first, reg, l.second);
+        }
+    }
+
+    // releases every member; resources nobody else references unload
+    // cost is proportional to the group size
+    void release() {
+        std::vector<handle> dropped;
+        dropped.swap(members);
+        dropped.clear();
+
+        //waiters of pending loads report to the old counters
+        counts = std::make_shared<counters>();
+    }
+
+    // progress of the members requested since the last release
+    group_progress progress() const {
+        return {members.size(), counts->loaded.load(), counts->failed.load(), counts->bytes.load()};
+    }
+
+    const std::string& name() const {
+        return group_name;
+    }
+
+    // handles of the members, in the order they were requested
+    const std::vector<handle>& handles() const {
+        return members;
+    }
+
+    ~resource_group() {
+        release();
+    }
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+// contention profiling of registry mutexes
+// included by lotus.hpp when LOTUS_PROFILE_LOCK is defined; registries then record wait and hold times
+// of every acquisition per operation, and call stacks of the worst waits
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define LOTUS_LOCK_BACKTRACE 1
+#endif
+
+//=================
+// Forwards
+
+namespace lotus {
+    // acquisition that waited long, with the call stack that requested it
+    struct lock_wait_sample;
+
+    // aggregated wait/hold times of one registry mutex
+    struct lock_profile;
+
+    // gathers lock_profile of a registry
+    struct lock_profiler;
+
+    // returns lock profile gathered by the registry so far
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    lock_profile profile_lock(resource_registry<resource_type, policy, loader_type>&);
+
+    // prints the profile as text; call stacks are symbolized where the platform allows it
+    void write_lock_profile(const lock_profile&, std::FILE*);
+}
+
+//=================
+// Lock Profile
+
+struct lotus::lock_wait_sample {
+    static constexpr int max_depth = 12;
+
+    std::uint64_t   wait;       //nanoseconds
+    lock_op         op;
+    int             depth;
+    void*           frames[max_depth];
+};
+
+struct lotus::lock_profile {
+    // bucket i counts samples of [2^i, 2^(i+1)) nanoseconds; bucket 0 also counts 0
+    static constexpr unsigned int buckets = 64;
+    static constexpr unsigned int op_count = static_cast<unsigned int>(lock_op::count);
+
+    struct op_profile {
+        std::uint64_t acquisitions  = 0;
+        std::uint64_t contended     = 0;    //acquisitions that couldn't take the mutex right away
+        std::uint64_t wait_total    = 0;    //nanoseconds
+        std::uint64_t hold_total    = 0;    //nanoseconds
+        std::uint64_t wait[buckets] = {};
+        std::uint64_t hold[buckets] = {};
+    };
+
+    op_profile                      ops[op_count];
+    std::vector<lock_wait_sample>   worst;  //longest waits, longest first
+
+    // returns upper bound (in nanoseconds) of the bucket holding given quantile (0..1)
+    static std::uint64_t percentile(const std::uint64_t (&histogram)[buckets], double quantile) {
+        std::uint64_t total = 0;
+        for (auto b : histogram) total += b;
+        if (total == 0) return 0;
+
+        auto target = static_cast<std::uint64_t>(quantile * (total - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (unsigned int i = 0; i < buckets; i++) {
+            seen += histogram[i];
+            if (seen >= target) return i + 1 < 64 ? (std::uint64_t(1) << (i + 1)) - 1 : UINT64_MAX;
+        }
+        return UINT64_MAX;
+    }
+};
+
+//=================
+// Lock Profiler
+
+struct lotus::lock_profiler {
+private:
+    static constexpr std::size_t worst_kept = 16;
+
+    struct op_counters {
+        std::atomic<std::uint64_t> acquisitions{0};
+        std::atomic<std::uint64_t> contended{0};
+        std::atomic<std::uint64_t> wait_total{0};
+        std::atomic<std::uint64_t> hold_total{0};
+        std::atomic<std::uint64_t> wait[lock_profile::buckets];
+        std::atomic<std::uint64_t> hold[lock_profile::buckets];
+
+        op_counters() {
+            for (auto& b : wait) b.store(0, std::memory_order_relaxed);
+            for (auto& b : hold) b.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    op_counters                     ops[lock_profile::op_count];
+
+    //waits shorter than the shortest kept sample skip taking a stack trace
+    std::atomic<std::uint64_t>      worst_threshold{0};
+    std::mutex                      worst_mutex;
+    std::vector<lock_wait_sample>   worst;
+
+    static unsigned int bucket(std::uint64_t ns) {
+        unsigned int b = 0;
+        while (ns > 1) {
+            ns >>= 1;
+            b++;
+        }
+        return b;
+    }
+
+    void sample(lock_op op, std::uint64_t wait) {
+        lock_wait_sample s;
+        s.wait  = wait;
+        s.op    = op;
+#if defined(LOTUS_LOCK_BACKTRACE)
+        s.depth = ::backtrace(s.frames, lock_wait_sample::max_depth);
+#elif defined(__GNUC__)
+        s.depth = 1;
+        s.frames[0] = __builtin_return_address(0);
+#else
+        s.depth = 0;
+#endif
+
+        std::lock_guard<std::mutex> lock(worst_mutex);
+
+        auto shorter = [](const lock_wait_sample& a, const lock_wait_sample& b) { return a.wait > b.wait; };
+        worst.insert(std::upper_bound(worst.begin(), worst.end(), s, shorter), s);
+        if (worst.size() > worst_kept) worst.pop_back();
+
+        if (worst.size() == worst_kept) worst_threshold.store(worst.back().wait, std::memory_order_relaxed);
+    }
+
+public:
+    static std::uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    void record_wait(lock_op op, std::uint64_t wait, bool contended) {
+        auto& o = ops[static_cast<unsigned int>(op)];
+        o.acquisitions.fetch_add(1, std::memory_order_relaxed);
+        o.wait_total.fetch_add(wait, std::memory_order_relaxed);
+        o.wait[bucket(wait)].fetch_add(1, std::memory_order_relaxed);
+
+        if (!contended) return;
+
+        o.contended.fetch_add(1, std::memory_order_relaxed);
+        if (wait > worst_threshold.load(std::memory_order_relaxed)) sample(op, wait);
+    }
+
+    void record_hold(lock_op op, std::uint64_t hold) {
+        auto& o = ops[static_cast<unsigned int>(op)];
+        o.hold_total.fetch_add(hold, std::memory_order_relaxed);
+        o.hold[bucket(hold)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    lock_profile snapshot() {
+        lock_profile p;
+
+        for (unsigned int i = 0; i < lock_profile::op_count; i++) {
+            auto& from = ops[i];
+            auto& to = p.ops[i];
+
+            to.acquisitions = from.acquisitions.load(std::memory_order_relaxed);
+            to.contended    = from.contended.load(std::memory_order_relaxed);
+            to.wait_total   = from.wait_total.load(std::memory_order_relaxed);
+            to.hold_total   = from.hold_total.load(std::memory_order_relaxed);
+
+            for (unsigned int b = 0; b < lock_profile::buckets; b++) {
+                to.wait[b] = from.wait[b].load(std::memory_order_relaxed);
+                to.hold[b] = from.hold[b].load(std::memory_order_relaxed);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(worst_mutex);
+        p.worst = worst;
+        return p;
+    }
+};
+
+//=================
+// Functions
+
+template<class resource_type, class policy, class loader_type>
+lotus::lock_profile lotus::profile_lock(resource_registry<resource_type, policy, loader_type>& reg) {
+    return reg.profiler.snapshot();
+}
+
+inline void lotus::write_lock_profile(const lock_profile& p, std::FILE* out) {
+    static const char* names[] = {
+        "get", "reg", "complete", "abandon", "release", "reload_registry", "unload_registry", "reload", "depend", "pin", "inspect", "expire", "evict"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == lock_profile::op_count, "lock_op names out of date");
+
+    std::fprintf(out, "%-16s %12s %10s %12s %12s %12s %12s %12s\n",
+        "op", "acquired", "contended", "wait total", "wait p50", "wait p99", "hold p50", "hold p99");
+
+    for (unsigned int i = 0; i < lock_profile::op_count; i++) {
+        auto& o = p.ops[i];
+        if (!o.acquisitions) continue;
+
+        std::fprintf(out, "%-16s %12llu %10llu %10lluus %10lluns %10lluns %10lluns %10lluns\n", names[i],
+            (unsigned long long)o.acquisitions, (unsigned long long)o.contended,
+            (unsigned long long)(o.wait_total / 1000),
+            (unsigned long long)lock_profile::percentile(o.wait, 0.5), (unsigned long long)lock_profile::percentile(o.wait, 0.99),
+            (unsigned long long)lock_profile::percentile(o.hold, 0.5), (unsigned long long)lock_profile::percentile(o.hold, 0.99));
+    }
+
+    for (auto& s : p.worst) {
+        std::fprintf(out, "\nwaited %lluns in %s:\n", (unsigned long long)s.wait, names[static_cast<unsigned int>(s.op)]);
+
+#if defined(LOTUS_LOCK_BACKTRACE)
+        auto symbols = ::backtrace_symbols(s.frames, s.depth);
+        for (int f = 0; f < s.depth; f++) std::fprintf(out, "    %s\n", symbols ? symbols[f] : "?");
+        std::free(symbols);
+#else
+        for (int f = 0; f < s.depth; f++) std::fprintf(out, "    %p\n", s.frames[f]);
+#endif
+    }
+}
@@ -2,268 +2,1990 @@
 
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <vector>
 #include <string>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <functional>
 #include <unordered_map>
 
+#include "policy.hpp"
+#include "timer_wheel.hpp"
+
+//define LOTUS_TRACE to record spans of registry activity (see trace.hpp)
+#if defined(LOTUS_TRACE)
+#include "trace.hpp"
+#else
+#define LOTUS_TRACE_SPAN(name, resource)
+#define LOTUS_TRACE_ASYNC_BEGIN(name, id, resource)
+#define LOTUS_TRACE_ASYNC_END(name, id)
+#endif
+
 //=================
 // Forwards
 
 namespace lotus {
+    // loader calling a pair of resource_request_callback / resource_unload_callback function pointers (default)
+    template<class resource_type, class policy>
+    struct function_loader;
+
+    // loader calling a pair of callable objects (e.g. lambdas), which the compiler can inline
+    template<class load_function, class unload_function>
+    struct callable_loader;
+
     // reference to resource
     // resource lifetime is bound to it's handles; when last handle expires the resource is unloaded
-    template<class resource_type>
+    template<class resource_type, class policy = multi_threaded, class loader_type = function_loader<resource_type, policy>>
     struct resource_handle;
 
     // registry of resources of given type
-    template<class resource_type>
+    // policy selects lock, index, key and reference count types (see policy.hpp)
+    //
+    // loader_type is stored in the registry and constructed from the registry constructor arguments; it may keep
+    // state (file handles, caches) and must provide, callable from any thread using the registry:
+    //   void load(const char* name, resource_registry<...>&, load_token<...>)    starts loading the resource
+    //   void unload(resource_type*)                                              releases a loaded resource
+    template<class resource_type, class policy = multi_threaded, class loader_type = function_loader<resource_type, policy>>
     struct resource_registry;
 
+    // identifies a single load started by the registry
+    // becomes cancelled when every handle to the resource expires before the load completes
+    template<class resource_type, class policy = multi_threaded, class loader_type = function_loader<resource_type, policy>>
+    struct load_token;
+
+    // dependencies declared by a load; the load continues once all of them are loaded
+    // dependencies may live in other registries, of other resource types, but must not form cycles
+    // while the resource stays loaded its dependencies are kept loaded, and reloading a dependency reloads it
+    template<class resource_type, class policy = multi_threaded, class loader_type = function_loader<resource_type, policy>>
+    struct dependency_set;
+
+    // keeps the version of a resource seen when it was taken, even when a finer level or a refresh is published meanwhile
+    template<class resource_type, class policy = multi_threaded, class loader_type = function_loader<resource_type, policy>>
+    struct resource_pin;
+
+    // resources requested and released together (see group.hpp)
+    template<class resource_type, class policy = multi_threaded, class loader_type = function_loader<resource_type, policy>>
+    struct resource_group;
+
     // called when resource requested by "get" function is not loaded
-    template<class resource_type>
-    using resource_request_callback = void(*)(const char*, resource_registry<resource_type>&);
+    // the load shall be finished with "complete" (possibly later, from another thread)
+    template<class resource_type, class policy = multi_threaded>
+    using resource_request_callback = void(*)(const char*, resource_registry<resource_type, policy>&, load_token<resource_type, policy>);
 
     // called when the resource is no longer in use
     template<class resource_type>
     using resource_unload_callback = void(*)(resource_type*);
 
+    // observes registry accesses (e.g. to record traces); receives the context pointer and resource name
+    using access_hook = void(*)(void*, const char*);
+
+    // registry activity reported to the event hook
+    enum class registry_event {
+        get,
+        reg,
+        release,            //last handle of the resource expired
+        reload_registry,    //reported without a resource name
+        unload_registry,    //reported without a resource name
+        reload,
+        refresh,
+    };
+
+    // observes registry activity (e.g. to record workloads for replay); receives the context pointer,
+    // the event and resource name (nullptr for registry wide events)
+    using event_hook = void(*)(void*, registry_event, const char*);
+
+    // called when a pending load finishes; receives the context pointer and whether the resource was published
+    using ready_hook = void(*)(void*, bool);
+
+    // load of a resource that used another one, possibly from another registry
+    // stale once the dependent is unloaded or loaded again
+    struct dependent_link {
+        void*           entry;
+        unsigned int    ticket;
+        unsigned int    used;       //ticket of the dependency load it used
+        void            (*reload)(void* entry, unsigned int ticket, bool refresh);
+        bool            (*stale)(void* entry, unsigned int ticket);
+    };
+
+    // negative caching of failed loads: the first failure holds retries off for initial_ns,
+    // every further failure in a row multiplies the wait by factor, up to max_ns
+    struct retry_policy {
+        std::uint64_t   initial_ns  = 1000000000ull;
+        std::uint64_t   max_ns      = 60000000000ull;
+        unsigned int    factor      = 2;
+    };
+
+    // what happens to a resource once its time to live passes
+    enum class expiry_action {
+        evict,      //unloaded if no handle references it; otherwise it unloads with its last handle, as usual
+        refresh,    //loaded again in the background; handles keep the old object until the new one is published
+    };
+
+    // snapshot of a registry entry
+    struct resource_info {
+        std::string     name;
+        unsigned int    accesses;   //"get" calls since the entry was created
+        std::uint64_t   load_time;  //nanoseconds the last load took; 0 for registered resources
+    };
+
+    // operations taking the registry mutex
+    enum class lock_op {
+        get,
+        reg,
+        complete,
+        abandon,
+        release,            //last handle expiring
+        reload_registry,
+        unload_registry,
+        reload,
+        depend,             //declaring a dependency
+        pin,
+        inspect,            //stats and listings
+        expire,
+        evict,              //changing the resident budget
+        count
+    };
+
+    // guard of the registry mutex; with LOTUS_PROFILE_LOCK defined it records wait and hold times (see lock_profiler.hpp)
+    template<class mutex_type>
+    struct registry_lock;
+
+    // counters and latency histograms of a registry
+    struct registry_stats;
+
+    // per-thread shards gathering registry_stats; define LOTUS_NO_STATS to compile them out
+    template<class policy>
+    struct stats_shards;
+
     // returns handle to a resource in registry
     // thread safe
-    template<class resource_type> 
-    resource_handle<resource_type> get(const char*, resource_registry<resource_type>&);
+    template<class resource_type, class policy, class loader_type> 
+    resource_handle<resource_type, policy, loader_type> get(const char*, resource_registry<resource_type, policy, loader_type>&);
+
+    // calls hook once the load pending for the handle's resource finishes, with whether it was published, or right
+    // away when no load is pending; the hook runs outside of the registry mutex
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    void when_ready(const resource_handle<resource_type, policy, loader_type>&, ready_hook, void*);
 
     // register resource in registry under given name
     // after this call the registry shall be in charge of resource deletion
     // thread safe
-    template<class resource_type>
-    void reg(const char*, resource_type*, resource_registry<resource_type>&);
+    template<class resource_type, class policy, class loader_type>
+    void reg(const char*, resource_type*, resource_registry<resource_type, policy, loader_type>&);
+
+    // publishes the object loaded for given token
+    // bytes is the size of the resource, reported to groups (0 when unknown)
+    // if the load was cancelled in the meantime the object is unloaded instead and false is returned
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    bool complete(const load_token<resource_type, policy, loader_type>&, resource_type*, std::uint64_t bytes = 0);
+
+    // publishes a coarse version of the resource while its load goes on (e.g. a low mip or a mesh lod)
+    // handles show the finest version published so far, until "complete" publishes the final object;
+    // levels grow with quality, and an object coarser than the one shown is unloaded right away
+    // a superseded version is unloaded once no resource_pin holds it; plain reads through a handle
+    // must not outlive the next publication
+    // returns false and unloads the object if the load was cancelled
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    bool publish(const load_token<resource_type, policy, loader_type>&, resource_type*, unsigned int level);
+
+    // gives up the load for given token (e.g. when the resource could not be read)
+    // the resource goes back to unloaded, so the next "get" will request it again
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    void abandon(const load_token<resource_type, policy, loader_type>&);
+
+    // ends the load for given token as failed, recording the error (e.g. "file not found")
+    // "get" calls report the failure without calling the loader until the retry backoff passes; each failure in a
+    // row grows the backoff (see retry_policy), and a successful load resets it
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    void fail(const load_token<resource_type, policy, loader_type>&, const char* error);
+
+    // sets how long failed loads are cached before "get" retries them
+    // not thread safe, set before the registry is shared between threads
+    template<class resource_type, class policy, class loader_type>
+    void set_retry_policy(resource_registry<resource_type, policy, loader_type>&, const retry_policy&);
 
     // unloads and loads all currently loaded resources
     // requieres none of the resources is read at the time
-    template<class resource_type>
-    void reload_registry(resource_registry<resource_type>&);
+    template<class resource_type, class policy, class loader_type>
+    void reload_registry(resource_registry<resource_type, policy, loader_type>&);
 
     // unloads all loaded resources
     // requieres none of the resources is read at the time
-    template<class resource_type>
-    void unload_registry(resource_registry<resource_type>&);
+    template<class resource_type, class policy, class loader_type>
+    void unload_registry(resource_registry<resource_type, policy, loader_type>&);
+
+    // unloads and loads the resource if it is loaded; resources depending on it are reloaded once it is published
+    // returns whether the reload was started
+    // requieres the resource is not read at the time
+    template<class resource_type, class policy, class loader_type>
+    bool reload(const char*, resource_registry<resource_type, policy, loader_type>&);
+
+    // loads the resource again while handles keep reading the current object; once the new object is published by
+    // "complete" it replaces the old one, which is unloaded (or once no resource_pin holds it)
+    // plain reads through a handle must not outlive the replacement; coarse versions published meanwhile are dropped
+    // if the refresh is abandoned or fails the old object stays, and an expiring resource is refreshed again after
+    // the retry policy's initial backoff
+    // returns whether the refresh was started: the resource is loaded and no refresh of it is pending
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    bool refresh(const char*, resource_registry<resource_type, policy, loader_type>&);
+
+    // sets the time to live of resources whose names start with prefix, counted from when their load is published
+    // (or they are registered); the longest matching prefix wins, and a full name sets the ttl of a single resource
+    // ttl_ns of 0 removes the rule, and pending expiries of resources no rule covers any more are dropped; other
+    // changes apply to loads published after the call
+    // expiry is tracked in a timer wheel of 10ms ticks, so it never scans the registry; see "expire"
+    // not thread safe, set before the registry is shared between threads
+    template<class resource_type, class policy, class loader_type>
+    void set_ttl(resource_registry<resource_type, policy, loader_type>&, const char* prefix, std::uint64_t ttl_ns, expiry_action);
+
+    // evicts or refreshes resources whose time to live has passed; returns how many expired
+    // call periodically, e.g. once per frame or from a timer thread; refresh loads are requested from the calling thread
+    // takes the registry mutex for about one step per 10ms tick elapsed while resources expire within 2.56s, or per
+    // slot of the coarser wheel levels otherwise (see timer_wheel.hpp), plus the expiring resources
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    std::size_t expire(resource_registry<resource_type, policy, loader_type>&);
+
+    // keeps resources loaded after their last handle expires, as long as the bytes of such idle resources (reported
+    // by "complete") fit the budget; the least recently released ones are evicted first, and a "get" takes an idle
+    // resource back without loading it; resources of unknown size don't count towards the budget
+    // a budget of 0 (the default) unloads resources with their last handle, evicting every idle one
+    // may be changed at any time, e.g. under memory pressure (see memory_monitor.hpp); shrinking evicts right away
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    void set_resident_budget(resource_registry<resource_type, policy, loader_type>&, std::uint64_t bytes);
+
+    // lists currently loaded resources
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    std::vector<resource_info> loaded_resources(resource_registry<resource_type, policy, loader_type>&);
+
+    // names the lock profiler type whether or not profiling is compiled in
+    struct lock_profiler;
+
+    // sums statistics gathered by the registry so far
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    registry_stats stats(resource_registry<resource_type, policy, loader_type>&);
+
+    // sets the object handles point at while resources whose names start with prefix aren't loaded
+    // (the object parameter isn't deduced, so nullptr can be passed)
+    // the longest matching prefix wins; "" sets the fallback of the whole registry; nullptr removes it
+    // the fallback stays owned by the caller and must outlive handles of the registry
+    // not thread safe, set before the registry is shared between threads
+    template<class resource_type, class policy, class loader_type>
+    void set_fallback(resource_registry<resource_type, policy, loader_type>&, const char* prefix, typename std::common_type<resource_type>::type*);
+
+    // installs hook called on every "get", replacing all installed ones; nullptr removes them
+    // hooks run outside of the registry mutex, after the returned handle took its reference and before the
+    // load callback of a miss
+    // not thread safe, install before the registry is shared between threads
+    template<class resource_type, class policy, class loader_type>
+    void set_access_hook(resource_registry<resource_type, policy, loader_type>&, access_hook, void*);
+
+    // installs another hook called on every "get", after the ones installed before
+    // not thread safe, install before the registry is shared between threads
+    template<class resource_type, class policy, class loader_type>
+    void add_access_hook(resource_registry<resource_type, policy, loader_type>&, access_hook, void*);
+
+    // removes a hook installed with given context
+    // not thread safe, remove once the registry is no longer used by other threads
+    template<class resource_type, class policy, class loader_type>
+    void remove_access_hook(resource_registry<resource_type, policy, loader_type>&, access_hook, void*);
+
+    // installs hook called on every registry_event; nullptr removes it
+    // the hook runs on the thread causing the event, outside of the registry mutex
+    // not thread safe, install before the registry is shared between threads
+    template<class resource_type, class policy, class loader_type>
+    void set_event_hook(resource_registry<resource_type, policy, loader_type>&, event_hook, void*);
 
     // returns whether the resource under handle is ready to use
     // bool resource_handle<resource_type>::good();
 
-    // reads the resource
-    // use only after checking good()
+    // returns whether the resource under handle is being loaded
+    // bool resource_handle<resource_type>::loading();
+
+    // reads the resource, or the fallback while it isn't loaded (nullptr when no fallback is set)
     //const resource_type* resource_handle<resource_type>::operator->() const 
+
+    // returns whether the handle shows the fallback instead of the resource
+    // bool resource_handle<resource_type>::is_fallback() const;
+
+    // returns whether nobody waits for the load anymore
+    // loaders should check it before starting queued work
+    // bool load_token<resource_type>::cancelled() const;
 }
 
+//define LOTUS_PROFILE_LOCK to profile registry mutex contention
+#if defined(LOTUS_PROFILE_LOCK)
+#include "lock_profiler.hpp"
+#endif
+
+//=================
+// Registry Lock
+
+template<class mutex_type>
+struct lotus::registry_lock {
+private:
+    std::unique_lock<mutex_type> lock;
+
+#if defined(LOTUS_PROFILE_LOCK)
+    lotus::lock_profiler*   profiler;
+    lotus::lock_op          op;
+    std::uint64_t           acquired;
+#endif
+
+public:
+    // contended is set when the mutex could not be taken right away
+    registry_lock(mutex_type& mutex, lotus::lock_op _op, lotus::lock_profiler* _profiler, bool& contended)
+        : lock(mutex, std::try_to_lock) {
+#if defined(LOTUS_PROFILE_LOCK)
+        profiler = _profiler;
+        op       = _op;
+        auto start = profiler->now();
+#else
+        (void)_op; (void)_profiler;
+#endif
+
+        contended = !lock.owns_lock();
+        if (contended) {
+            LOTUS_TRACE_SPAN("lock wait", nullptr);
+            lock.lock();
+        }
+
+#if defined(LOTUS_PROFILE_LOCK)
+        acquired = profiler->now();
+        profiler->record_wait(op, acquired - start, contended);
+#endif
+    }
+
+    registry_lock(registry_lock&& other) = default;
+
+    ~registry_lock() {
+        if (lock.owns_lock()) unlock();
+    }
+
+    void unlock() {
+#if defined(LOTUS_PROFILE_LOCK)
+        profiler->record_hold(op, profiler->now() - acquired);
+#endif
+        lock.unlock();
+    }
+};
+
+//=================
+// Statistics
+
+struct lotus::registry_stats {
+    enum counter {
+        hits,           //"get" found the resource loaded, already loading or recently failed
+        misses,         //"get" started a load
+        loads,          //loads published by "complete"
+        levels,         //coarse versions published by "publish"
+        unloads,        //unload callback calls
+        reloads,        //resources reloaded by "reload_registry"
+        refreshes,      //objects replaced by a finished "refresh"
+        evictions,      //unreferenced resources dropped to free memory or on expiry
+        cancellations,  //loads abandoned because every handle expired
+        failures,       //loads ended by "fail"
+        negative_hits,  //"get" calls answered by a failure whose backoff hasn't passed
+        contentions,    //registry mutex acquisitions that had to wait
+        counter_count
+    };
+
+    enum histogram {
+        get_latency,
+        load_latency,
+        unload_latency,
+        histogram_count
+    };
+
+    // bucket i counts samples of [2^i, 2^(i+1)) nanoseconds; bucket 0 also counts 0
+    static constexpr unsigned int buckets = 64;
+
+    std::uint64_t counters[counter_count] = {};
+    std::uint64_t histograms[histogram_count][buckets] = {};
+
+    // returns number of samples in the histogram
+    std::uint64_t samples(histogram h) const {
+        std::uint64_t total = 0;
+        for (auto b : histograms[h]) total += b;
+        return total;
+    }
+
+    // returns upper bound (in nanoseconds) of the bucket holding given quantile (0..1)
+    std::uint64_t percentile(histogram h, double quantile) const {
+        auto total = samples(h);
+        if (total == 0) return 0;
+
+        auto target = static_cast<std::uint64_t>(quantile * (total - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (unsigned int i = 0; i < buckets; i++) {
+            seen += histograms[h][i];
+            if (seen >= target) return i + 1 < 64 ? (std::uint64_t(1) << (i + 1)) - 1 : UINT64_MAX;
+        }
+        return UINT64_MAX;
+    }
+};
+
+template<class policy>
+struct lotus::stats_shards {
+private:
+    static constexpr unsigned int shard_count = policy::concurrent ? 16 : 1;
+
+    using counter_type = typename policy::template atomic<std::uint64_t>;
+
+    struct alignas(64) shard {
+        counter_type counters[registry_stats::counter_count];
+        counter_type histograms[registry_stats::histogram_count][registry_stats::buckets];
+    };
+
+#if !defined(LOTUS_NO_STATS)
+    shard shards[shard_count];
+
+    //threads are spread over shards round robin, so the counters rarely share a cache line between cores
+    shard& local() {
+        if (!policy::concurrent) return shards[0];
+
+        static std::atomic<unsigned int> next{0};
+        thread_local unsigned int index = next.fetch_add(1) % shard_count;
+        return shards[index];
+    }
+
+    static unsigned int bucket(std::uint64_t ns) {
+        unsigned int b = 0;
+        while (ns > 1) {
+            ns >>= 1;
+            b++;
+        }
+        return b;
+    }
+#endif
+
+public:
+    stats_shards() {
+#if !defined(LOTUS_NO_STATS)
+        for (auto& s : shards) {
+            for (auto& c : s.counters) c.store(0, std::memory_order_relaxed);
+            for (auto& h : s.histograms) for (auto& b : h) b.store(0, std::memory_order_relaxed);
+        }
+#endif
+    }
+
+    // current time for latency measurements; 0 when statistics are compiled out
+    static std::uint64_t now() {
+#if !defined(LOTUS_NO_STATS)
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+#else
+        return 0;
+#endif
+    }
+
+    void add(registry_stats::counter c, std::uint64_t n = 1) {
+#if !defined(LOTUS_NO_STATS)
+        local().counters[c].fetch_add(n, std::memory_order_relaxed);
+#else
+        (void)c; (void)n;
+#endif
+    }
+
+    void record(registry_stats::histogram h, std::uint64_t ns) {
+#if !defined(LOTUS_NO_STATS)
+        local().histograms[h][bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+#else
+        (void)h; (void)ns;
+#endif
+    }
+
+    registry_stats sum() const {
+        registry_stats total;
+#if !defined(LOTUS_NO_STATS)
+        for (auto& s : shards) {
+            for (unsigned int c = 0; c < registry_stats::counter_count; c++)
+                total.counters[c] += s.counters[c].load(std::memory_order_relaxed);
+
+            for (unsigned int h = 0; h < registry_stats::histogram_count; h++)
+                for (unsigned int b = 0; b < registry_stats::buckets; b++)
+                    total.histograms[h][b] += s.histograms[h][b].load(std::memory_order_relaxed);
+        }
+#endif
+        return total;
+    }
+};
+
+//=================
+// Loaders
+
+template<class resource_type, class policy>
+struct lotus::function_loader {
+private:
+    resource_request_callback<resource_type, policy>    request;
+    resource_unload_callback<resource_type>             release;
+
+public:
+    function_loader(resource_request_callback<resource_type, policy> _request, resource_unload_callback<resource_type> _release)
+        : request(_request), release(_release) {}
+
+    void load(const char* name, resource_registry<resource_type, policy>& reg, load_token<resource_type, policy> token) {
+        request(name, reg, token);
+    }
+
+    void unload(resource_type* object) {
+        release(object);
+    }
+};
+
+template<class load_function, class unload_function>
+struct lotus::callable_loader {
+private:
+    load_function   on_load;
+    unload_function on_unload;
+
+public:
+    callable_loader(load_function _on_load, unload_function _on_unload)
+        : on_load(std::move(_on_load)), on_unload(std::move(_on_unload)) {}
+
+    template<class registry_type, class token_type>
+    void load(const char* name, registry_type& reg, token_type token) {
+        on_load(name, reg, token);
+    }
+
+    template<class resource_type>
+    void unload(resource_type* object) {
+        on_unload(object);
+    }
+};
+
 //=================
 // Resource Registry
 
-template<class resource_type>
+template<class resource_type, class policy, class loader_type>
 struct lotus::resource_registry {
 private:
-    using shared = typename lotus::resource_handle<resource_type>::shared;
-    using states = typename lotus::resource_handle<resource_type>::states;
+    using shared = typename lotus::resource_handle<resource_type, policy, loader_type>::shared;
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    loader_type callbacks;
+
+    std::vector<std::pair<access_hook, void*>> hooks;
+
+    event_hook  events         = nullptr;
+    void*       events_context = nullptr;
+
+    //name prefixes with their fallbacks, longest prefix first
+    std::vector<std::pair<std::string, resource_type*>> fallbacks;
+
+    retry_policy retry;
+
+    //expiry of loaded entries, tagged with the ticket of the load they were scheduled for, so timers of entries
+    //unloaded or loaded again since are ignored; created by the first "set_ttl"
+    struct expiry_timer {
+        shared*         shr;
+        unsigned int    ticket;
+        expiry_action   action;
+    };
 
-    resource_request_callback<resource_type> rrc;
-    resource_unload_callback<resource_type>  ruc;
+    struct ttl_rule {
+        std::string     prefix;
+        std::uint64_t   ttl_ns;
+        expiry_action   action;
+    };
+
+    static constexpr std::uint64_t expiry_tick_ns = 10000000;
+
+    std::vector<ttl_rule>                                   ttls;       //longest prefix first
+    std::unique_ptr<lotus::timer_wheel<expiry_timer>>       expiry;
+    std::chrono::steady_clock::time_point                   expiry_origin;
+
+    //idle entries, most recently released first; guarded by mutex
+    std::uint64_t   resident_budget = 0;
+    std::uint64_t   idle_bytes      = 0;
+    shared*         idle_head       = nullptr;
+    shared*         idle_tail       = nullptr;
 
-    std::mutex mutex;
+    typename policy::mutex_type mutex;
 
-    std::unordered_map<
-        std::string,
-        shared*
+    lotus::stats_shards<policy> stats;
+
+#if defined(LOTUS_PROFILE_LOCK)
+    lotus::lock_profiler profiler;
+    lotus::lock_profiler* profiler_ptr() { return &profiler; }
+#else
+    lotus::lock_profiler* profiler_ptr() { return nullptr; }
+#endif
+
+    using keys = typename policy::keys;
+
+    typename policy::template map_type<
+        typename keys::key_type,
+        shared*,
+        typename keys::hash
     > reg;
 
-    friend resource_handle<resource_type> lotus::get<resource_type>(
-        const char*, resource_registry<resource_type>&
+    friend resource_handle<resource_type, policy, loader_type> lotus::get<resource_type, policy, loader_type>(
+        const char*, resource_registry<resource_type, policy, loader_type>&
+    );
+
+    friend void lotus::reg<resource_type, policy, loader_type>(
+        const char*, resource_type*, resource_registry<resource_type, policy, loader_type>&
+    );
+
+    friend bool lotus::complete<resource_type, policy, loader_type>(
+        const load_token<resource_type, policy, loader_type>&, resource_type*, std::uint64_t
     );
 
-    friend void lotus::reg<resource_type>(
-        const char*, resource_type*, resource_registry<resource_type>&
+    friend void lotus::abandon<resource_type, policy, loader_type>(const load_token<resource_type, policy, loader_type>&);
+    friend void lotus::fail<resource_type, policy, loader_type>(const load_token<resource_type, policy, loader_type>&, const char*);
+    friend void lotus::when_ready<resource_type, policy, loader_type>(const resource_handle<resource_type, policy, loader_type>&, ready_hook, void*);
+
+    friend bool lotus::publish<resource_type, policy, loader_type>(
+        const load_token<resource_type, policy, loader_type>&, resource_type*, unsigned int
     );
 
-    friend void reload_registry<resource_type>(resource_registry<resource_type>&);
-    friend void unload_registry<resource_type>(resource_registry<resource_type>&);
+    friend void reload_registry<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&);
+    friend void unload_registry<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&);
+    friend bool lotus::reload<resource_type, policy, loader_type>(const char*, resource_registry<resource_type, policy, loader_type>&);
+    friend bool lotus::refresh<resource_type, policy, loader_type>(const char*, resource_registry<resource_type, policy, loader_type>&);
+    friend std::size_t lotus::expire<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&);
+
+    template<class, class, class>
+    friend struct lotus::dependency_set;
+
+    template<class, class, class>
+    friend struct lotus::resource_group;
+
+    friend void lotus::set_ttl<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&, const char*, std::uint64_t, expiry_action);
+    friend void lotus::set_resident_budget<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&, std::uint64_t);
+    friend void lotus::set_access_hook<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&, access_hook, void*);
+    friend void lotus::add_access_hook<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&, access_hook, void*);
+    friend void lotus::remove_access_hook<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&, access_hook, void*);
+    friend void lotus::set_event_hook<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&, event_hook, void*);
+    friend void lotus::set_fallback<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&, const char*, resource_type*);
+    friend void lotus::set_retry_policy<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&, const retry_policy&);
+
+    friend std::vector<resource_info> lotus::loaded_resources<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&);
+
+    friend registry_stats lotus::stats<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&);
+
+#if defined(LOTUS_PROFILE_LOCK)
+    friend lock_profile lotus::profile_lock<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&);
+#endif
+
+    friend lotus::resource_handle<resource_type, policy, loader_type>;
+    friend lotus::resource_pin<resource_type, policy, loader_type>;
+
+    //locks the mutex on behalf of given operation, counting acquisitions that had to wait
+    lotus::registry_lock<typename policy::mutex_type> acquire(lotus::lock_op op) {
+        bool contended;
+        lotus::registry_lock<typename policy::mutex_type> lock(mutex, op, profiler_ptr(), contended);
+        if (contended) stats.add(registry_stats::contentions);
+        return lock;
+    }
+
+    //calls the unload callback, timing it
+    void unload_object(resource_type* object) {
+        LOTUS_TRACE_SPAN("unload", nullptr);
+        auto start = stats.now();
+        callbacks.unload(object);
+        stats.record(registry_stats::unload_latency, stats.now() - start);
+        stats.add(registry_stats::unloads);
+    }
+
+    //reports a "get" to the access hooks
+    void accessed(const char* name) {
+        for (auto& h : hooks) h.first(h.second, name);
+    }
 
-    friend lotus::resource_handle<resource_type>;
+    //reports an event to the event hook, if any
+    void notify(registry_event event, const char* name) {
+        if (events) events(events_context, event, name);
+    }
 
     //call under mutex
     shared* find_or_create_shared(const char* name) {
-        auto itr = reg.find(name); 
+        auto itr = reg.find(keys::make(name)); 
     
         if (itr == reg.end()) {
             auto shr = new shared;
 
             shr->state.store(states::unloaded);
-            shr->count.store(0);
+            shr->ticket.store(0);
             shr->object   = nullptr;
+            shr->fallback = fallback_for(name);
+            shr->shown    = nullptr;
+            shr->refreshing = false;
+            shr->idle = false;
+            shr->idle_prev = shr->idle_next = nullptr;
+            shr->view.store(shr->fallback);
             shr->registry = this;
+            shr->accesses = 0;
+            shr->load_time = 0;
+            shr->bytes = 0;
+            shr->name = name;
             
-            itr = reg.insert({name, shr}).first;
+            itr = reg.insert({keys::make(shr->name), shr}).first;
         }
 
         return itr->second;
     }
 
-public:
-    resource_registry(
-        resource_request_callback<resource_type> _rrc,
-        resource_unload_callback<resource_type>  _ruc
-    ) : rrc(_rrc), ruc(_ruc) {};
-};
+    //ends the load for given token without publishing anything: next is unloaded, or failed with the error recorded
+    //and retries held off with exponential backoff
+    void end_load(const load_token<resource_type, policy, loader_type>& token, states next, const char* error) {
+        auto shr = token.shr;
 
-//=================
-// Resource Handle
+        std::vector<std::shared_ptr<void>> dependencies;
+        std::vector<std::pair<ready_hook, void*>> waiters;
 
-template<class resource_type>
-struct lotus::resource_handle {
-private:
-    enum class states {
-        loaded,
-        unloaded,
-        waiting_load,
-    };
+        auto lock = acquire(lock_op::abandon);
 
-    struct shared {
-        std::atomic<states>                         state;
-        std::atomic<unsigned int>                   count;
-        resource_type*                              object;
-        lotus::resource_registry<resource_type>*    registry;
-    };
+        //a failed refresh keeps the old object and tries again later
+        if (!token.cancelled() && shr->refreshing) {
+            LOTUS_TRACE_ASYNC_END("load", load_id(shr, token.ticket));
+            detach_shown(shr);
+            if (shr->deps) dependencies.swap(shr->deps->refreshed);
+            if (next == states::failed) stats.add(registry_stats::failures);
+            schedule_expiry(shr, true);
+            lock.unlock();
+            return;
+        }
 
-    shared* shr;
+        auto expected = states::waiting_load;
+        resource_type* coarse = nullptr;
+        if (!token.cancelled() && shr->state.compare_exchange_strong(expected, next)) {
+            LOTUS_TRACE_ASYNC_END("load", load_id(shr, token.ticket));
+            shr->view.store(shr->fallback, std::memory_order_release);
+            shr->ticket.fetch_add(1);
+            coarse = retire_shown(shr);
 
-    friend resource_handle<resource_type> lotus::get<resource_type>(
-        const char*, resource_registry<resource_type>&
-    );
+            if (next == states::failed) {
+                if (!shr->failure) shr->failure.reset(new typename lotus::resource_handle<resource_type, policy, loader_type>::failed_load{});
 
-    friend void lotus::reg<resource_type>(
-        const char*, resource_type*, resource_registry<resource_type>&
-    );
+                auto& f = *shr->failure;
+                f.error = error;
+                f.backoff = f.failures++ ? std::min<std::uint64_t>(f.backoff * retry.factor, retry.max_ns) : retry.initial_ns;
+                f.retry_at = std::chrono::steady_clock::now() + std::chrono::nanoseconds(f.backoff);
+                stats.add(registry_stats::failures);
+            }
 
-    friend void reload_registry<resource_type>(resource_registry<resource_type>&);
-    friend void unload_registry<resource_type>(resource_registry<resource_type>&);
+            take_dependencies(shr, dependencies);
+            if (shr->deps) waiters.swap(shr->deps->waiters);
+        }
+        lock.unlock();
 
-    friend lotus::resource_registry<resource_type>;
+        if (coarse) unload_object(coarse);
+        for (auto& w : waiters) w.first(w.second, false);
+    }
 
-    resource_handle(shared* _shr) : shr(_shr) {
-        if (shr) shr->count.fetch_add(1, std::memory_order_acq_rel);
-    };
+    //call under mutex
+    //returns whether the entry shall be loaded: it is unloaded, or failed and its backoff has passed
+    bool needs_load(shared* shr) {
+        auto state = shr->state.load();
+        if (state == states::unloaded) return true;
+        if (state != states::failed) return false;
 
-public:
-    resource_handle() : shr(nullptr) {}  
-    
-    resource_handle(const resource_handle<resource_type>& other) : shr(other.shr) {                
-        if (shr) shr->count.fetch_add(1, std::memory_order_acq_rel);
+        if (std::chrono::steady_clock::now() < shr->failure->retry_at) {
+            stats.add(registry_stats::negative_hits);
+            return false;
+        }
+        return true;
     }
 
-    resource_handle<resource_type>& operator=(const resource_handle<resource_type>& other) {                
-        if (shr == other.shr) return *this;
+    //call under mutex
+    //takes the coarse version shown during a load off the entry; returns its object when nobody pins it,
+    //to be unloaded after unlocking
+    resource_type* retire_shown(shared* shr) {
+        auto v = shr->shown;
+        if (!v) return nullptr;
 
-        this->~resource_handle();
-        new(this) resource_handle(other.shr);
+        shr->shown = nullptr;
+        if (v->pins) {
+            v->retired = true;
+            return nullptr;
+        }
 
-        return *this;
+        auto object = v->object;
+        delete v;
+        return object;
     }
 
-    ~resource_handle() {                
-        if (shr && shr->count.fetch_sub(1, std::memory_order_acq_rel) == 1 && shr->state.load() == states::loaded) {
-            shr->state.store(states::unloaded);
-            shr->registry->ruc(shr->object);
-        }
-        shr = nullptr;
-    } 
+    //call under mutex, with the entry loaded
+    //takes the version of the loaded object (created by pins or a refresh) off the entry without unloading the object,
+    //ending a pending refresh; pins keep the version, which doesn't own the object anymore
+    void detach_shown(shared* shr) {
+        shr->refreshing = false;
 
-    // returns whether the resource under handle is ready to use
-    const bool good() const {
-        return shr->state.load() == states::loaded;
+        auto v = shr->shown;
+        if (!v) return;
+
+        shr->shown = nullptr;
+        if (v->pins) {
+            v->object  = nullptr;
+            v->retired = true;
+        }
+        else delete v;
     }
 
-    // reads the resource
-    // use only after checking good()
-    const resource_type* operator->() const {
-        return shr->object;
+    //call under mutex
+    //moves the handles the entry keeps to its dependencies, including those of a pending refresh, to out,
+    //to be released after unlocking
+    void take_dependencies(shared* shr, std::vector<std::shared_ptr<void>>& out) {
+        if (!shr->deps) return;
+
+        for (auto held : {&shr->deps->dependencies, &shr->deps->refreshed}) {
+            out.insert(out.end(), std::make_move_iterator(held->begin()), std::make_move_iterator(held->end()));
+            held->clear();
+        }
     }
-};
 
-//=================
-// Functions
+    //call under mutex
+    resource_type* fallback_for(const char* name) const {
+        for (auto& f : fallbacks)
+            if (!std::strncmp(name, f.first.c_str(), f.first.size())) return f.second;
+        return nullptr;
+    }
 
-template<class resource_type>
-lotus::resource_handle<resource_type> lotus::get(
-    const char*                         name, 
-    resource_registry<resource_type>&   reg
-) {
-    using shared = typename lotus::resource_handle<resource_type>::shared;
-    using states = typename lotus::resource_handle<resource_type>::states;
+    //call under mutex
+    //moves resource into waiting_load, showing the fallback to handles; returns token of the started load
+    load_token<resource_type, policy, loader_type> begin_load(shared* shr, const char* name) {
+        if (shr->state.load() == states::loaded) detach_shown(shr);
+        unlink_idle(shr);
 
-    std::lock_guard<std::mutex> lock(reg.mutex);
-    auto shr = reg.find_or_create_shared(name);
-    lock.~lock_guard();
+        shr->load_start = std::chrono::steady_clock::now();
+        shr->view.store(shr->fallback, std::memory_order_release);
+        shr->state.store(states::waiting_load);
 
-    if (shr->state.load() == states::unloaded) {
-        reg.rrc(name, reg);
+        auto ticket = shr->ticket.fetch_add(1) + 1;
+        LOTUS_TRACE_ASYNC_BEGIN("load", load_id(shr, ticket), name);
+        (void)name; //used by tracing only
+        return load_token<resource_type, policy, loader_type>{shr, ticket};
     }
 
-    return lotus::resource_handle<resource_type>{shr};
-}
+    //call under mutex, with the entry loaded
+    //starts loading the resource again while handles keep showing the current object, held as a version so pins
+    //keep it alive once it is replaced; a pending refresh is superseded; returns token of the started load
+    load_token<resource_type, policy, loader_type> begin_refresh(shared* shr) {
+        if (!shr->shown) shr->shown = new_version(shr->object);
+        shr->refreshing = true;
+        shr->load_start = std::chrono::steady_clock::now();
 
-template<class resource_type>
-void lotus::reg(
-    const char*                         name, 
-    resource_type*                      object, 
-    resource_registry<resource_type>&   reg
-) {
-    using shared = typename lotus::resource_handle<resource_type>::shared;
-    using states = typename lotus::resource_handle<resource_type>::states;
+        auto ticket = shr->ticket.fetch_add(1) + 1;
+        LOTUS_TRACE_ASYNC_BEGIN("load", load_id(shr, ticket), shr->name.c_str());
+        return load_token<resource_type, policy, loader_type>{shr, ticket};
+    }
 
-    std::lock_guard<std::mutex> lock(reg.mutex);
-    auto shr = reg.find_or_create_shared(name);
-    lock.~lock_guard();
+    //call under mutex, with the entry loaded and unreferenced
+    //releases racing on the count may both get here; the entry is linked once
+    void make_idle(shared* shr) {
+        if (shr->idle) return;
 
-    shr->object = object;
-    shr->state.store(states::loaded);
-}
+        shr->idle = true;
+        shr->idle_prev = nullptr;
+        shr->idle_next = idle_head;
+        if (idle_head) idle_head->idle_prev = shr;
+        else idle_tail = shr;
+        idle_head = shr;
+        idle_bytes += shr->bytes;
+    }
 
+    //call under mutex
+    void unlink_idle(shared* shr) {
+        if (!shr->idle) return;
 
-template<class resource_type>
-void lotus::reload_registry(resource_registry<resource_type>& reg) {
-    using shared = typename lotus::resource_handle<resource_type>::shared;
-    using states = typename lotus::resource_handle<resource_type>::states;
+        (shr->idle_prev ? shr->idle_prev->idle_next : idle_head) = shr->idle_next;
+        (shr->idle_next ? shr->idle_next->idle_prev : idle_tail) = shr->idle_prev;
+        shr->idle_prev = shr->idle_next = nullptr;
+        shr->idle = false;
+        idle_bytes -= shr->bytes;
+    }
 
-    std::lock_guard<std::mutex> lock(reg.mutex);
+    //call under mutex, with the entry loaded and unreferenced
+    //unloads the entry; its object and dependencies are collected to be released after unlocking
+    void evict(shared* shr, std::vector<resource_type*>& objects, std::vector<std::shared_ptr<void>>& dependencies) {
+        unlink_idle(shr);
+        shr->state.store(states::unloaded);
+        shr->view.store(shr->fallback, std::memory_order_release);
+        shr->ticket.fetch_add(1);
+        detach_shown(shr);
+        take_dependencies(shr, dependencies);
+        objects.push_back(shr->object);
+    }
 
-    //cache and call after unlocking the lock to avoid deadlock with reg func
-    std::vector<std::string> to_load;
+    //call under mutex
+    //evicts the least recently released idle entries until the rest fit the resident budget
+    void evict_idle(std::vector<resource_type*>& objects, std::vector<std::shared_ptr<void>>& dependencies) {
+        while (idle_tail && (!resident_budget || idle_bytes > resident_budget))
+            evict(idle_tail, objects, dependencies);
+    }
 
-    for (auto& p : reg.reg) {
-        auto& shr = p.second;
-        
-        if (shr->state.load() == states::loaded) {
-            shr->state.store(states::unloaded);
-            reg.ruc(shr->object);
-            to_load.push_back(p.first);
-        }
+    //unloads objects collected by "evict", after unlocking
+    void unload_evicted(const std::vector<resource_type*>& objects) {
+        stats.add(registry_stats::evictions, objects.size());
+        for (auto object : objects) unload_object(object);
     }
 
-    lock.~lock_guard();
-    for (auto& res : to_load) reg.rrc(res.c_str(), reg);
+    //version of a loaded object; finer than any level, so coarse versions published by a refresh are dropped
+    static typename lotus::resource_handle<resource_type, policy, loader_type>::version* new_version(resource_type* object) {
+        return new typename lotus::resource_handle<resource_type, policy, loader_type>::version{object, ~0u, 0, false};
+    }
+
+    //call under mutex
+    //longest ttl rule matching the name of the entry, or nullptr
+    const ttl_rule* ttl_rule_of(shared* shr) const {
+        for (auto& r : ttls)
+            if (!std::strncmp(shr->name.c_str(), r.prefix.c_str(), r.prefix.size())) return &r;
+        return nullptr;
+    }
+
+    //call under mutex, with the entry loaded
+    //schedules expiry of the entry according to the longest matching ttl rule; after a refresh that didn't publish,
+    //refresh rules retry once the initial retry backoff passes instead
+    void schedule_expiry(shared* shr, bool retry_refresh) {
+        if (!expiry) return;
+
+        auto rule = ttl_rule_of(shr);
+        if (!rule) return;
+
+        auto delay = retry_refresh && rule->action == expiry_action::refresh ? retry.initial_ns : rule->ttl_ns;
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - expiry_origin).count();
+        auto deadline = (static_cast<std::uint64_t>(elapsed) + delay + expiry_tick_ns - 1) / expiry_tick_ns;
+        expiry->schedule(deadline, {shr, shr->ticket.load(), rule->action});
+    }
+
+    //identifies a load in traces
+    static std::uint64_t load_id(shared* shr, unsigned int ticket) {
+        return reinterpret_cast<std::uintptr_t>(shr) * 31 + ticket;
+    }
+
+    //call under mutex
+    typename lotus::resource_handle<resource_type, policy, loader_type>::links& links_of(shared* shr) {
+        if (!shr->deps) shr->deps.reset(new typename lotus::resource_handle<resource_type, policy, loader_type>::links);
+        return *shr->deps;
+    }
+
+    //call under mutex, with the entry loaded
+    //unloads the object and requests the resource again; unlocks the mutex
+    void restart_load(shared* shr, lotus::registry_lock<typename policy::mutex_type>& lock) {
+        auto object = shr->object;
+        auto token  = begin_load(shr, shr->name.c_str());
+        lock.unlock();
+
+        unload_object(object);
+        stats.add(registry_stats::reloads);
+
+        LOTUS_TRACE_SPAN("load callback", shr->name.c_str());
+        callbacks.load(shr->name.c_str(), *this, token);
+    }
+
+    //call under mutex, with the entry loaded
+    //refreshes the resource; unlocks the mutex
+    void restart_refresh(shared* shr, lotus::registry_lock<typename policy::mutex_type>& lock) {
+        auto token = begin_refresh(shr);
+        lock.unlock();
+
+        LOTUS_TRACE_SPAN("load callback", shr->name.c_str());
+        callbacks.load(shr->name.c_str(), *this, token);
+    }
+
+    //dependent_link callbacks; entries are never freed, so links may outlive the loads they describe
+    //dependents of a refreshed resource are refreshed too, as their handles may still be reading the objects
+    static void reload_dependent(void* entry, unsigned int ticket, bool refresh) {
+        auto shr  = static_cast<shared*>(entry);
+        auto lock = shr->registry->acquire(lock_op::reload);
+
+        if (shr->state.load() != states::loaded || shr->ticket.load() != ticket) return;
+
+        if (refresh) shr->registry->restart_refresh(shr, lock);
+        else         shr->registry->restart_load(shr, lock);
+    }
+
+    static bool stale_dependent(void* entry, unsigned int ticket) {
+        return static_cast<shared*>(entry)->ticket.load() != ticket;
+    }
+
+public:
+    // arguments are passed to the loader constructor, e.g. load and unload callbacks of function_loader
+    template<class... loader_args>
+    explicit resource_registry(loader_args&&... args) : callbacks(std::forward<loader_args>(args)...) {}
+
+    resource_registry(const resource_registry&) = delete;
+    resource_registry& operator=(const resource_registry&) = delete;
+
+    // returns the loader, e.g. to reach its state from outside
+    loader_type& loader() {
+        return callbacks;
+    }
+
+    const loader_type& loader() const {
+        return callbacks;
+    }
+};
+
+//=================
+// Resource Handle
+
+template<class resource_type, class policy, class loader_type>
+struct lotus::resource_handle {
+private:
+    enum class states {
+        loaded,
+        unloaded,
+        waiting_load,
+        failed,         //the last load failed; "get" doesn't retry before the backoff passes
+    };
+
+    template<class T>
+    using atomic = typename policy::template atomic<T>;
+
+    //dependency bookkeeping, created on first use; guarded by registry mutex
+    struct links {
+        std::vector<std::pair<ready_hook, void*>>   waiters;        //notified when the pending load finishes
+        std::vector<dependent_link>                 dependents;     //loads that used this resource
+        std::vector<std::shared_ptr<void>>          dependencies;   //handles kept while this resource is loaded
+        std::vector<std::shared_ptr<void>>          refreshed;      //dependencies of a pending refresh
+    };
+
+    //last failed load, created on the first failure; guarded by registry mutex
+    struct failed_load {
+        std::string                             error;
+        unsigned int                            failures;   //in a row
+        std::uint64_t                           backoff;    //nanoseconds
+        std::chrono::steady_clock::time_point   retry_at;
+    };
+
+    //coarse version published during a load, or the loaded object pinned or being refreshed; guarded by registry mutex
+    struct version {
+        resource_type*  object;
+        unsigned int    level;
+        unsigned int    pins;
+        bool            retired;    //superseded; unloaded with the last pin
+    };
+
+    struct shared {
+        atomic<states>                                      state;
+        typename policy::refcount_type                      count;
+        atomic<unsigned int>                                ticket;     //id of the newest load; bumped on cancellation
+        resource_type*                                      object;
+        atomic<const resource_type*>                        view;       //object when loaded, fallback otherwise
+        resource_type*                                      fallback;
+        lotus::resource_registry<resource_type, policy, loader_type>*    registry;
+        std::string                                         name;       //viewed by the index key; never changes
+        std::unique_ptr<links>                              deps;
+        version*                                            shown;      //coarse version shown while loading, or
+                                                                        //the loaded object's once pinned or refreshed
+        std::unique_ptr<failed_load>                        failure;
+        bool                                                refreshing; //loaded, with a refresh pending
+        bool                                                idle;       //loaded and unreferenced, kept by the budget
+        shared*                                             idle_prev;  //more recently released idle entry
+        shared*                                             idle_next;
+
+        //guarded by registry mutex
+        unsigned int                                        accesses;
+        std::chrono::steady_clock::time_point               load_start;
+        std::uint64_t                                       load_time;
+        std::uint64_t                                       bytes;      //reported by complete; 0 when unknown
+    };
+
+    shared* shr;
+
+    friend resource_handle<resource_type, policy, loader_type> lotus::get<resource_type, policy, loader_type>(
+        const char*, resource_registry<resource_type, policy, loader_type>&
+    );
+
+    friend void lotus::reg<resource_type, policy, loader_type>(
+        const char*, resource_type*, resource_registry<resource_type, policy, loader_type>&
+    );
+
+    friend bool lotus::complete<resource_type, policy, loader_type>(
+        const load_token<resource_type, policy, loader_type>&, resource_type*, std::uint64_t
+    );
+
+    friend void lotus::abandon<resource_type, policy, loader_type>(const load_token<resource_type, policy, loader_type>&);
+    friend void lotus::fail<resource_type, policy, loader_type>(const load_token<resource_type, policy, loader_type>&, const char*);
+    friend void lotus::when_ready<resource_type, policy, loader_type>(const resource_handle<resource_type, policy, loader_type>&, ready_hook, void*);
+
+    friend bool lotus::publish<resource_type, policy, loader_type>(
+        const load_token<resource_type, policy, loader_type>&, resource_type*, unsigned int
+    );
+
+    friend void reload_registry<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&);
+    friend void unload_registry<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&);
+    friend bool lotus::reload<resource_type, policy, loader_type>(const char*, resource_registry<resource_type, policy, loader_type>&);
+    friend bool lotus::refresh<resource_type, policy, loader_type>(const char*, resource_registry<resource_type, policy, loader_type>&);
+    friend std::size_t lotus::expire<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&);
+
+    template<class, class, class>
+    friend struct lotus::dependency_set;
+
+    template<class, class, class>
+    friend struct lotus::resource_group;
+
+    friend std::vector<resource_info> lotus::loaded_resources<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&);
+    friend void lotus::set_fallback<resource_type, policy, loader_type>(resource_registry<resource_type, policy, loader_type>&, const char*, resource_type*);
+
+    friend lotus::resource_registry<resource_type, policy, loader_type>;
+    friend lotus::load_token<resource_type, policy, loader_type>;
+    friend lotus::resource_pin<resource_type, policy, loader_type>;
+
+    resource_handle(shared* _shr) : shr(_shr) {
+        if (shr) shr->count.acquire();
+    };
+
+    // called by the last expiring handle
+    void release_last() {
+        shr->registry->notify(registry_event::release, shr->name.c_str());
+
+        //dependencies are released after unlocking, as they may live in this registry
+        std::vector<std::shared_ptr<void>> dependencies;
+        std::vector<std::pair<ready_hook, void*>> waiters;
+
+        //get takes its reference under the mutex, so recheck the count there; a concurrent get may have
+        //picked the resource up again after the count dropped to zero
+        auto lock = shr->registry->acquire(lock_op::release);
+        if (shr->count.load() != 0) return;
+
+        //the budget keeps the resource loaded; others may be evicted to make room
+        auto registry = shr->registry;
+        if (registry->resident_budget && shr->state.load() == states::loaded) {
+            std::vector<resource_type*> evicted;
+
+            registry->make_idle(shr);
+            registry->evict_idle(evicted, dependencies);
+            lock.unlock();
+
+            registry->unload_evicted(evicted);
+            return;
+        }
+
+        auto current = states::loaded;
+        if (shr->state.compare_exchange_strong(current, states::unloaded)) {
+            //once unlocked, a new load may replace the object
+            auto object = shr->object;
+            shr->view.store(shr->fallback, std::memory_order_release);
+            shr->ticket.fetch_add(1);
+            shr->registry->detach_shown(shr);
+            shr->registry->take_dependencies(shr, dependencies);
+            lock.unlock();
+            shr->registry->unload_object(object);
+            return;
+        }
+
+        //complete takes the mutex too, so a pending load can be abandoned without racing its publication
+        if (current == states::waiting_load) {
+            shr->state.store(states::unloaded);
+            shr->view.store(shr->fallback, std::memory_order_release);
+            LOTUS_TRACE_ASYNC_END("load", shr->registry->load_id(shr, shr->ticket.load()));
+            shr->ticket.fetch_add(1);
+            shr->registry->stats.add(registry_stats::cancellations);
+
+            auto coarse = shr->registry->retire_shown(shr);
+            shr->registry->take_dependencies(shr, dependencies);
+            if (shr->deps) waiters.swap(shr->deps->waiters);
+            lock.unlock();
+
+            if (coarse) shr->registry->unload_object(coarse);
+            for (auto& w : waiters) w.first(w.second, false);
+        }
+    }
+
+public:
+    resource_handle() : shr(nullptr) {}  
+    
+    resource_handle(const resource_handle<resource_type, policy, loader_type>& other) : shr(other.shr) {                
+        if (shr) shr->count.acquire();
+    }
+
+    resource_handle<resource_type, policy, loader_type>& operator=(const resource_handle<resource_type, policy, loader_type>& other) {                
+        if (shr == other.shr) return *this;
+
+        this->~resource_handle();
+        new(this) resource_handle(other.shr);
+
+        return *this;
+    }
+
+    ~resource_handle() {                
+        if (shr && shr->count.release()) release_last();
+        shr = nullptr;
+    } 
+
+    // returns whether the resource under handle is ready to use
+    const bool good() const {
+        return shr->state.load() == states::loaded;
+    }
+
+    // returns whether the resource under handle is being loaded
+    bool loading() const {
+        return shr->state.load() == states::waiting_load;
+    }
+
+    // returns whether the last load of the resource failed
+    bool failed() const {
+        return shr->state.load() == states::failed;
+    }
+
+    // returns the error the last failed load reported; empty when the resource didn't fail
+    std::string error() const {
+        auto lock = shr->registry->acquire(lock_op::inspect);
+        return shr->state.load() == states::failed ? shr->failure->error : std::string();
+    }
+
+    // reads the resource, or the fallback while it isn't loaded (nullptr when no fallback is set)
+    // the pointer is only valid until the object shown is replaced: a coarse version by the next "publish" or
+    // "complete", a loaded object by a finished "refresh"; read through a resource_pin ("pin") across those
+    const resource_type* operator->() const {
+        return shr->view.load(std::memory_order_acquire);
+    }
+
+    // returns whether the handle shows the fallback instead of the resource or a coarse version of it
+    bool is_fallback() const {
+        return shr->view.load(std::memory_order_relaxed) == shr->fallback;
+    }
+
+    // keeps the version shown now loaded while the pin lives, even if a finer level or a refresh replaces it
+    resource_pin<resource_type, policy, loader_type> pin() const {
+        return resource_pin<resource_type, policy, loader_type>(*this);
+    }
+};
+
+//=================
+// Resource Pin
+
+template<class resource_type, class policy, class loader_type>
+struct lotus::resource_pin {
+private:
+    using handle  = lotus::resource_handle<resource_type, policy, loader_type>;
+    using version = typename handle::version;
+
+    handle                  owner;      //keeps the entry, and so a published final object, loaded
+    version*                pinned;     //coarse version, if one was shown
+    const resource_type*    object;
+
+    friend handle;
+
+    resource_pin(const handle& _owner) : owner(_owner), pinned(nullptr) {
+        auto shr  = owner.shr;
+        auto lock = shr->registry->acquire(lock_op::pin);
+
+        //the view and shown version only change under the mutex, apart from a final "reg"
+        object = shr->view.load(std::memory_order_acquire);
+
+        //a loaded object gets a version too, so a refresh replacing it leaves it to the pins
+        if (!shr->shown && object && object == shr->object && shr->state.load() == handle::states::loaded)
+            shr->shown = shr->registry->new_version(shr->object);
+
+        if (shr->shown && shr->shown->object == object) {
+            pinned = shr->shown;
+            pinned->pins++;
+        }
+    }
+
+    void unpin() {
+        if (!pinned) return;
+
+        auto registry = owner.shr->registry;
+        auto lock = registry->acquire(lock_op::pin);
+
+        if (--pinned->pins || !pinned->retired) {
+            pinned = nullptr;
+            return;
+        }
+
+        //versions of an abandoned refresh don't own their object
+        auto retired = pinned->object;
+        delete pinned;
+        pinned = nullptr;
+        lock.unlock();
+        if (retired) registry->unload_object(retired);
+    }
+
+public:
+    resource_pin(const resource_pin&) = delete;
+    resource_pin& operator=(const resource_pin&) = delete;
+
+    resource_pin(resource_pin&& other) : owner(other.owner), pinned(other.pinned), object(other.object) {
+        other.pinned = nullptr;
+    }
+
+    ~resource_pin() {
+        unpin();
+    }
+
+    // reads the pinned version (the fallback or nullptr when nothing was published)
+    const resource_type* operator->() const {
+        return object;
+    }
+
+    // returns the pinned object
+    const resource_type* get() const {
+        return object;
+    }
+};
+
+//=================
+// Load Token
+
+template<class resource_type, class policy, class loader_type>
+struct lotus::load_token {
+private:
+    using shared = typename lotus::resource_handle<resource_type, policy, loader_type>::shared;
+
+    shared*         shr;
+    unsigned int    ticket;
+
+    friend lotus::resource_registry<resource_type, policy, loader_type>;
+
+    friend bool lotus::complete<resource_type, policy, loader_type>(
+        const load_token<resource_type, policy, loader_type>&, resource_type*, std::uint64_t
+    );
+
+    friend void lotus::abandon<resource_type, policy, loader_type>(const load_token<resource_type, policy, loader_type>&);
+    friend void lotus::fail<resource_type, policy, loader_type>(const load_token<resource_type, policy, loader_type>&, const char*);
+
+    friend bool lotus::publish<resource_type, policy, loader_type>(
+        const load_token<resource_type, policy, loader_type>&, resource_type*, unsigned int
+    );
+
+    template<class, class, class>
+    friend struct lotus::dependency_set;
+
+    load_token(shared* _shr, unsigned int _ticket) : shr(_shr), ticket(_ticket) {}
+
+public:
+    // returns whether nobody waits for the load anymore
+    // loaders should check it before starting queued work
+    bool cancelled() const {
+        return shr->ticket.load() != ticket;
+    }
+};
+
+//=================
+// Dependency Set
+
+template<class resource_type, class policy, class loader_type>
+struct lotus::dependency_set {
+private:
+    using shared     = typename lotus::resource_handle<resource_type, policy, loader_type>::shared;
+    using token_type = lotus::load_token<resource_type, policy, loader_type>;
+
+    struct state {
+        token_type                                      token;
+        typename policy::template atomic<unsigned int>  pending{1};    //dependencies not ready yet, plus one until "then"
+        typename policy::template atomic<bool>          failed{false};
+        typename policy::mutex_type                     mutex;          //guards held
+        std::vector<std::shared_ptr<void>>              held;
+        std::function<void(bool)>                       continuation;
+
+        state(const token_type& _token) : token(_token) {}
+    };
+
+    std::shared_ptr<state> st;
+
+    static void arrive(const std::shared_ptr<state>& s, bool ready) {
+        if (!ready) s->failed.store(true);
+        if (s->pending.fetch_sub(1) != 1) return;
+
+        bool ok = !s->failed.load();
+        if (ok) {
+            //the resource keeps its dependencies loaded from now on; the previous ones are dropped after unlocking
+            std::vector<std::shared_ptr<void>> previous;
+
+            auto shr  = s->token.shr;
+            auto lock = shr->registry->acquire(lock_op::depend);
+            if (!s->token.cancelled()) {
+                //a refresh keeps the dependencies of the object still shown until it is published
+                auto& links = shr->registry->links_of(shr);
+                auto& held  = shr->refreshing ? links.refreshed : links.dependencies;
+                previous.swap(held);
+                held.swap(s->held);
+            }
+            lock.unlock();
+        }
+
+        s->continuation(ok);
+    }
+
+    static void ready(void* context, bool published) {
+        auto s = static_cast<std::shared_ptr<state>*>(context);
+        arrive(*s, published);
+        delete s;
+    }
+
+public:
+    explicit dependency_set(const token_type& token) : st(std::make_shared<state>(token)) {}
+
+    // declares a dependency, usually straight from "get"; returns the handle
+    // dependencies are requested as they are added, so independent ones load in parallel
+    template<class dependency_type, class dependency_policy, class dependency_loader>
+    const resource_handle<dependency_type, dependency_policy, dependency_loader>& add(
+        const resource_handle<dependency_type, dependency_policy, dependency_loader>& dependency
+    ) {
+        using dependency_states = typename resource_handle<dependency_type, dependency_policy, dependency_loader>::states;
+
+        {
+            std::lock_guard<typename policy::mutex_type> lock(st->mutex);
+            st->held.push_back(std::make_shared<resource_handle<dependency_type, dependency_policy, dependency_loader>>(dependency));
+        }
+        st->pending.fetch_add(1);
+
+        auto dep  = dependency.shr;
+        auto lock = dep->registry->acquire(lock_op::depend);
+        auto& links = dep->registry->links_of(dep);
+
+        links.dependents.erase(std::remove_if(links.dependents.begin(), links.dependents.end(), [](const dependent_link& l) {
+            return l.stale(l.entry, l.ticket);
+        }), links.dependents.end());
+
+        links.dependents.push_back({
+            st->token.shr, st->token.ticket, dep->ticket.load(),
+            &resource_registry<resource_type, policy, loader_type>::reload_dependent,
+            &resource_registry<resource_type, policy, loader_type>::stale_dependent
+        });
+
+        auto current = dep->state.load();
+        if (current == dependency_states::waiting_load) {
+            links.waiters.push_back({&ready, new std::shared_ptr<state>(st)});
+            return dependency;
+        }
+
+        lock.unlock();
+        arrive(st, current == dependency_states::loaded);
+        return dependency;
+    }
+
+    // runs the continuation once every added dependency is loaded, with true, or once any of them failed to load,
+    // with false (the load should then be abandoned); call exactly once, after adding all dependencies
+    // the continuation runs on the thread publishing the last dependency, or right away when all are loaded
+    void then(std::function<void(bool)> continuation) {
+        st->continuation = std::move(continuation);
+        arrive(st, true);
+    }
+};
+
+//=================
+// Functions
+
+template<class resource_type, class policy, class loader_type>
+lotus::resource_handle<resource_type, policy, loader_type> lotus::get(
+    const char*                         name, 
+    resource_registry<resource_type, policy, loader_type>&   reg
+) {
+    using shared = typename lotus::resource_handle<resource_type, policy, loader_type>::shared;
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    LOTUS_TRACE_SPAN("get", name);
+
+    reg.notify(registry_event::get, name);
+
+    auto start = reg.stats.now();
+
+    auto lock = reg.acquire(lock_op::get);
+    auto shr = reg.find_or_create_shared(name);
+    shr->accesses++;
+    reg.unlink_idle(shr);
+
+    //take the reference before unlocking so a concurrently expiring handle can't cancel the load
+    lotus::resource_handle<resource_type, policy, loader_type> handle{shr};
+
+    if (!reg.needs_load(shr)) {
+        lock.unlock();
+        reg.accessed(name);
+        reg.stats.add(registry_stats::hits);
+        reg.stats.record(registry_stats::get_latency, reg.stats.now() - start);
+        return handle;
+    }
+
+    auto token = reg.begin_load(shr, name);
+    lock.unlock();
+
+    //hooks see the access once the handle holds its reference, so they may let go of their own handles
+    reg.accessed(name);
+
+    {
+        LOTUS_TRACE_SPAN("load callback", name);
+        reg.callbacks.load(name, reg, token);
+    }
+
+    reg.stats.add(registry_stats::misses);
+    reg.stats.record(registry_stats::get_latency, reg.stats.now() - start);
+    return handle;
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::when_ready(
+    const resource_handle<resource_type, policy, loader_type>&   handle,
+    ready_hook                          hook,
+    void*                               context
+) {
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    auto shr = handle.shr;
+    if (!shr) return hook(context, false);
+
+    auto lock = shr->registry->acquire(lock_op::depend);
+
+    auto state = shr->state.load();
+    if (state == states::waiting_load) {
+        shr->registry->links_of(shr).waiters.push_back({hook, context});
+        return;
+    }
+
+    lock.unlock();
+    hook(context, state == states::loaded);
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::reg(
+    const char*                         name, 
+    resource_type*                      object, 
+    resource_registry<resource_type, policy, loader_type>&   reg
+) {
+    using shared = typename lotus::resource_handle<resource_type, policy, loader_type>::shared;
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    reg.notify(registry_event::reg, name);
+
+    std::vector<std::pair<ready_hook, void*>> waiters;
+
+    auto lock = reg.acquire(lock_op::reg);
+    auto shr = reg.find_or_create_shared(name);
+    if (shr->state.load() == states::loaded) reg.detach_shown(shr);
+    auto coarse = reg.retire_shown(shr);
+    if (shr->deps) waiters.swap(shr->deps->waiters);
+    reg.schedule_expiry(shr, false);
+    lock.unlock();
+
+    shr->object = object;
+    shr->view.store(object, std::memory_order_release);
+    shr->state.store(states::loaded);
+
+    if (coarse) reg.unload_object(coarse);
+    for (auto& w : waiters) w.first(w.second, true);
+}
+
+template<class resource_type, class policy, class loader_type>
+bool lotus::complete(
+    const load_token<resource_type, policy, loader_type>&    token, 
+    resource_type*                      object,
+    std::uint64_t                       bytes
+) {
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    auto shr = token.shr;
+    auto registry = shr->registry;
+
+    std::vector<std::pair<ready_hook, void*>> waiters;
+    std::vector<dependent_link> dependents;
+    std::vector<std::shared_ptr<void>> replaced;    //dependencies of the object a refresh replaces, and of evicted entries
+    std::vector<resource_type*> evicted;
+
+    auto lock = registry->acquire(lock_op::complete);
+
+    auto refreshed = shr->refreshing;
+    if (token.cancelled() || (shr->state.load() != states::waiting_load && !refreshed)) {
+        lock.unlock();
+        registry->stats.add(registry_stats::cancellations);
+        registry->unload_object(object);
+        return false;
+    }
+
+    auto load_time = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - shr->load_start
+    ).count());
+    shr->load_time = load_time;
+
+    if (shr->idle) registry->idle_bytes += bytes - shr->bytes;
+
+    shr->object = object;
+    shr->bytes  = bytes;
+    shr->view.store(object, std::memory_order_release);
+    shr->state.store(states::loaded);
+
+    //a refresh retires the old object like a coarse version
+    auto coarse = registry->retire_shown(shr);
+    shr->refreshing = false;
+    shr->failure.reset();
+
+    if (shr->deps) {
+        waiters.swap(shr->deps->waiters);
+
+        if (refreshed) {
+            replaced.swap(shr->deps->dependencies);
+            shr->deps->dependencies.swap(shr->deps->refreshed);
+        }
+
+        //dependents still holding a load that used a previous object are reloaded
+        auto& links = shr->deps->dependents;
+        links.erase(std::remove_if(links.begin(), links.end(), [](const dependent_link& l) {
+            return l.stale(l.entry, l.ticket);
+        }), links.end());
+
+        for (auto& l : links)
+            if (l.used != token.ticket) dependents.push_back(l);
+    }
+
+    registry->schedule_expiry(shr, false);
+
+    //loads nobody holds a handle to (reloads of idle resources) are kept by the budget, like released ones
+    if (registry->resident_budget && !shr->count.load()) registry->make_idle(shr);
+    if (registry->resident_budget) registry->evict_idle(evicted, replaced);
+    lock.unlock();
+
+    registry->unload_evicted(evicted);
+
+    LOTUS_TRACE_ASYNC_END("load", registry->load_id(shr, token.ticket));
+    registry->stats.add(registry_stats::loads);
+    if (refreshed) registry->stats.add(registry_stats::refreshes);
+    registry->stats.record(registry_stats::load_latency, load_time);
+
+    if (coarse) registry->unload_object(coarse);
+
+    for (auto& w : waiters) w.first(w.second, true);
+    for (auto& d : dependents) d.reload(d.entry, d.ticket, refreshed);
+    return true;
+}
+
+template<class resource_type, class policy, class loader_type>
+bool lotus::publish(
+    const load_token<resource_type, policy, loader_type>&    token,
+    resource_type*                      object,
+    unsigned int                        level
+) {
+    using states  = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+    using version = typename lotus::resource_handle<resource_type, policy, loader_type>::version;
+
+    auto shr = token.shr;
+    auto registry = shr->registry;
+
+    auto lock = registry->acquire(lock_op::complete);
+
+    bool current = !token.cancelled() && (shr->state.load() == states::waiting_load || shr->refreshing);
+    if (!current || (shr->shown && shr->shown->level >= level)) {
+        lock.unlock();
+        registry->unload_object(object);
+        return current;
+    }
+
+    auto coarser = registry->retire_shown(shr);
+    shr->shown = new version{object, level, 0, false};
+    shr->view.store(object, std::memory_order_release);
+    lock.unlock();
+
+    registry->stats.add(registry_stats::levels);
+    if (coarser) registry->unload_object(coarser);
+    return true;
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::abandon(const load_token<resource_type, policy, loader_type>& token) {
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    token.shr->registry->end_load(token, states::unloaded, nullptr);
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::fail(const load_token<resource_type, policy, loader_type>& token, const char* error) {
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    token.shr->registry->end_load(token, states::failed, error ? error : "");
 }
 
-template<class resource_type>
-void lotus::unload_registry(resource_registry<resource_type>& reg) {
-    using shared = typename lotus::resource_handle<resource_type>::shared;
-    using states = typename lotus::resource_handle<resource_type>::states;
+template<class resource_type, class policy, class loader_type>
+void lotus::set_retry_policy(resource_registry<resource_type, policy, loader_type>& reg, const retry_policy& retry) {
+    reg.retry = retry;
+}
 
-    std::lock_guard<std::mutex> lock(reg.mutex);
+template<class resource_type, class policy, class loader_type>
+void lotus::reload_registry(resource_registry<resource_type, policy, loader_type>& reg) {
+    using shared = typename lotus::resource_handle<resource_type, policy, loader_type>::shared;
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    reg.notify(registry_event::reload_registry, nullptr);
+
+    auto lock = reg.acquire(lock_op::reload_registry);
+
+    //cache and call after unlocking the lock to avoid deadlock with reg func
+    //names are owned by the entries, which are never freed
+    std::vector<std::pair<const char*, lotus::load_token<resource_type, policy, loader_type>>> to_load;
+
+    //unload callbacks may be slow (e.g. compressing the object), so they run after unlocking too
+    std::vector<resource_type*> objects;
+
+    for (auto& p : reg.reg) {
+        auto& shr = p.second;
+        
+        if (shr->state.load() == states::loaded) {
+            objects.push_back(shr->object);
+            to_load.push_back({shr->name.c_str(), reg.begin_load(shr, shr->name.c_str())});
+        }
+    }
+
+    lock.unlock();
+    for (auto object : objects) reg.unload_object(object);
+    reg.stats.add(registry_stats::reloads, to_load.size());
+    for (auto& res : to_load) {
+        LOTUS_TRACE_SPAN("load callback", res.first);
+        reg.callbacks.load(res.first, reg, res.second);
+    }
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::unload_registry(resource_registry<resource_type, policy, loader_type>& reg) {
+    using shared = typename lotus::resource_handle<resource_type, policy, loader_type>::shared;
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    reg.notify(registry_event::unload_registry, nullptr);
+
+    //dependencies and objects are released after unlocking, as dependencies may live in this registry and
+    //unload callbacks may be slow
+    std::vector<std::shared_ptr<void>> dependencies;
+    std::vector<resource_type*> objects;
+
+    auto lock = reg.acquire(lock_op::unload_registry);
 
     for (auto& p : reg.reg) {
         auto& shr = p.second;
         
         if (shr->state.load() == states::loaded) {
             shr->state.store(states::unloaded);
-            reg.ruc(shr->object);
+            shr->view.store(shr->fallback, std::memory_order_release);
+            shr->ticket.fetch_add(1);
+            objects.push_back(shr->object);
+            reg.unlink_idle(shr);
+            reg.detach_shown(shr);
+            reg.take_dependencies(shr, dependencies);
         }
     }
+
+    lock.unlock();
+    for (auto object : objects) reg.unload_object(object);
+}
+
+template<class resource_type, class policy, class loader_type>
+bool lotus::reload(const char* name, resource_registry<resource_type, policy, loader_type>& reg) {
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    reg.notify(registry_event::reload, name);
+
+    auto lock = reg.acquire(lock_op::reload);
+
+    auto itr = reg.reg.find(resource_registry<resource_type, policy, loader_type>::keys::make(name));
+    if (itr == reg.reg.end() || itr->second->state.load() != states::loaded) return false;
+
+    //dependencies stay held until the new load declares its own
+    reg.restart_load(itr->second, lock);
+    return true;
+}
+
+template<class resource_type, class policy, class loader_type>
+bool lotus::refresh(const char* name, resource_registry<resource_type, policy, loader_type>& reg) {
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    reg.notify(registry_event::refresh, name);
+
+    auto lock = reg.acquire(lock_op::reload);
+
+    auto itr = reg.reg.find(resource_registry<resource_type, policy, loader_type>::keys::make(name));
+    if (itr == reg.reg.end() || itr->second->state.load() != states::loaded || itr->second->refreshing) return false;
+
+    auto shr   = itr->second;
+    auto token = reg.begin_refresh(shr);
+    lock.unlock();
+
+    LOTUS_TRACE_SPAN("load callback", shr->name.c_str());
+    reg.callbacks.load(shr->name.c_str(), reg, token);
+    return true;
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::set_ttl(
+    resource_registry<resource_type, policy, loader_type>&   reg,
+    const char*                         prefix,
+    std::uint64_t                       ttl_ns,
+    expiry_action                       action
+) {
+    using rule = typename resource_registry<resource_type, policy, loader_type>::ttl_rule;
+    using wheel = lotus::timer_wheel<typename resource_registry<resource_type, policy, loader_type>::expiry_timer>;
+
+    auto lock = reg.acquire(lock_op::inspect);
+
+    if (!reg.expiry) {
+        reg.expiry.reset(new wheel);
+        reg.expiry_origin = std::chrono::steady_clock::now();
+    }
+
+    auto& t = reg.ttls;
+    t.erase(std::remove_if(t.begin(), t.end(), [&](const rule& r) {
+        return r.prefix == prefix;
+    }), t.end());
+
+    if (ttl_ns) {
+        auto pos = std::find_if(t.begin(), t.end(), [&](const rule& r) {
+            return r.prefix.size() < std::strlen(prefix);
+        });
+        t.insert(pos, rule{prefix, ttl_ns, action});
+    }
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::set_resident_budget(resource_registry<resource_type, policy, loader_type>& reg, std::uint64_t bytes) {
+    std::vector<resource_type*> evicted;
+    std::vector<std::shared_ptr<void>> dependencies;
+
+    auto lock = reg.acquire(lock_op::evict);
+    reg.resident_budget = bytes;
+    reg.evict_idle(evicted, dependencies);
+    lock.unlock();
+
+    reg.unload_evicted(evicted);
+}
+
+template<class resource_type, class policy, class loader_type>
+std::size_t lotus::expire(resource_registry<resource_type, policy, loader_type>& reg) {
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+    using timer  = typename resource_registry<resource_type, policy, loader_type>::expiry_timer;
+
+    if (!reg.expiry) return 0;
+
+    //objects, dependencies and loads are handled after unlocking
+    std::vector<resource_type*> evicted;
+    std::vector<std::shared_ptr<void>> dependencies;
+    std::vector<std::pair<const char*, lotus::load_token<resource_type, policy, loader_type>>> to_load;
+    std::size_t expired = 0;
+
+    auto lock = reg.acquire(lock_op::expire);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - reg.expiry_origin).count();
+    reg.expiry->advance(static_cast<std::uint64_t>(elapsed) / reg.expiry_tick_ns, [&](const timer& t) {
+        auto shr = t.shr;
+        if (shr->state.load() != states::loaded || shr->ticket.load() != t.ticket) return;
+
+        //the rule may have been removed since the timer was scheduled
+        if (!reg.ttl_rule_of(shr)) return;
+        expired++;
+
+        if (t.action == expiry_action::refresh) {
+            to_load.push_back({shr->name.c_str(), reg.begin_refresh(shr)});
+            return;
+        }
+
+        //get takes its reference under the mutex, so an unreferenced entry stays unreferenced until unlocking
+        if (shr->count.load() == 0) reg.evict(shr, evicted, dependencies);
+    });
+
+    lock.unlock();
+
+    reg.unload_evicted(evicted);
+
+    for (auto& l : to_load) {
+        LOTUS_TRACE_SPAN("load callback", l.first);
+        reg.callbacks.load(l.first, reg, l.second);
+    }
+    return expired;
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::set_access_hook(
+    resource_registry<resource_type, policy, loader_type>&   reg, 
+    access_hook                         hook, 
+    void*                               context
+) {
+    reg.hooks.clear();
+    if (hook) reg.hooks.push_back({hook, context});
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::add_access_hook(
+    resource_registry<resource_type, policy, loader_type>&   reg, 
+    access_hook                         hook, 
+    void*                               context
+) {
+    reg.hooks.push_back({hook, context});
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::remove_access_hook(
+    resource_registry<resource_type, policy, loader_type>&   reg, 
+    access_hook                         hook, 
+    void*                               context
+) {
+    auto& h = reg.hooks;
+    h.erase(std::remove(h.begin(), h.end(), std::make_pair(hook, context)), h.end());
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::set_event_hook(
+    resource_registry<resource_type, policy, loader_type>&   reg, 
+    event_hook                          hook, 
+    void*                               context
+) {
+    reg.events         = hook;
+    reg.events_context = context;
+}
+
+template<class resource_type, class policy, class loader_type>
+void lotus::set_fallback(
+    resource_registry<resource_type, policy, loader_type>&   reg,
+    const char*                         prefix,
+    typename std::common_type<resource_type>::type* fallback
+) {
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    auto lock = reg.acquire(lock_op::inspect);
+
+    auto& f = reg.fallbacks;
+    f.erase(std::remove_if(f.begin(), f.end(), [&](const std::pair<std::string, resource_type*>& p) {
+        return p.first == prefix;
+    }), f.end());
+
+    if (fallback) {
+        auto pos = std::find_if(f.begin(), f.end(), [&](const std::pair<std::string, resource_type*>& p) {
+            return p.first.size() < std::strlen(prefix);
+        });
+        f.insert(pos, {prefix, fallback});
+    }
+
+    //existing entries pick up the change too
+    for (auto& p : reg.reg) {
+        auto& shr = p.second;
+
+        shr->fallback = reg.fallback_for(shr->name.c_str());
+        if (shr->state.load() != states::loaded) shr->view.store(shr->fallback, std::memory_order_release);
+    }
+}
+
+template<class resource_type, class policy, class loader_type>
+std::vector<lotus::resource_info> lotus::loaded_resources(resource_registry<resource_type, policy, loader_type>& reg) {
+    using states = typename lotus::resource_handle<resource_type, policy, loader_type>::states;
+
+    auto lock = reg.acquire(lock_op::inspect);
+
+    std::vector<lotus::resource_info> loaded;
+    for (auto& p : reg.reg) {
+        auto& shr = p.second;
+
+        if (shr->state.load() == states::loaded)
+            loaded.push_back({shr->name, shr->accesses, shr->load_time});
+    }
+
+    return loaded;
+}
+
+template<class resource_type, class policy, class loader_type>
+lotus::registry_stats lotus::stats(resource_registry<resource_type, policy, loader_type>& reg) {
+    return reg.stats.sum();
 }
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+//=================
+// Forwards
+
+namespace lotus {
+    // compresses bytes with a byte-oriented lz77 codec (lz4 style sequences of literals and matches of 4+ bytes
+    // within 64KB), fast enough to run on every eviction; replaces the contents of out
+    void lz_compress(const void* data, std::size_t size, std::vector<unsigned char>& out);
+
+    // restores exactly size bytes compressed by lz_compress into out; returns false when the input is malformed
+    // or doesn't decompress to size bytes
+    bool lz_decompress(const unsigned char* data, std::size_t compressed, void* out, std::size_t size);
+}
+
+//=================
+// Codec
+
+namespace lotus {
+namespace lz_detail {
+    constexpr unsigned int  hash_bits   = 12;
+    constexpr std::size_t   min_match   = 4;
+    constexpr std::size_t   max_offset  = 65535;
+
+    inline std::uint32_t read32(const unsigned char* p) {
+        std::uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    //lengths past the 4-bit field continue in bytes of 255, ending with a smaller one
+    inline void write_length(std::vector<unsigned char>& out, std::size_t length) {
+        for (; length >= 255; length -= 255) out.push_back(255);
+        out.push_back(static_cast<unsigned char>(length));
+    }
+
+    inline bool read_length(const unsigned char* data, std::size_t compressed, std::size_t& pos, std::size_t& length) {
+        for (;;) {
+            if (pos >= compressed) return false;
+            auto b = data[pos++];
+            length += b;
+            if (b != 255) return true;
+        }
+    }
+
+    //token: literal count in the high nibble, match length - 4 in the low one; the last sequence has no match
+    inline void write_sequence(std::vector<unsigned char>& out, const unsigned char* literals, std::size_t count,
+                               std::size_t offset, std::size_t match) {
+        auto lit_field   = count < 15 ? count : 15;
+        auto match_field = match ? (match - min_match < 15 ? match - min_match : 15) : 0;
+        out.push_back(static_cast<unsigned char>(lit_field << 4 | match_field));
+
+        if (lit_field == 15) write_length(out, count - 15);
+        out.insert(out.end(), literals, literals + count);
+        if (!match) return;
+
+        out.push_back(static_cast<unsigned char>(offset));
+        out.push_back(static_cast<unsigned char>(offset >> 8));
+        if (match_field == 15) write_length(out, match - min_match - 15);
+    }
+}
+}
+
+inline void lotus::lz_compress(const void* data, std::size_t size, std::vector<unsigned char>& out) {
+    using namespace lz_detail;
+
+    auto src = static_cast<const unsigned char*>(data);
+    out.clear();
+    out.reserve(size + size / 255 + 16);
+
+    //positions + 1 of the last occurrence of each hashed 4-byte sequence; 0 when none
+    std::vector<std::uint32_t> table(std::size_t(1) << hash_bits, 0);
+
+    std::size_t pos = 0, anchor = 0;
+    while (pos + min_match <= size) {
+        auto value = read32(src + pos);
+        auto& slot = table[(value * 2654435761u) >> (32 - hash_bits)];
+        std::size_t candidate = slot;
+        slot = static_cast<std::uint32_t>(pos + 1);
+
+        if (!candidate || pos - (candidate - 1) > max_offset || read32(src + candidate - 1) != value) {
+            pos++;
+            continue;
+        }
+
+        auto from = candidate - 1;
+        auto length = min_match;
+        while (pos + length < size && src[from + length] == src[pos + length]) length++;
+
+        write_sequence(out, src + anchor, pos - anchor, pos - from, length);
+        pos += length;
+        anchor = pos;
+    }
+
+    write_sequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+inline bool lotus::lz_decompress(const unsigned char* data, std::size_t compressed, void* out, std::size_t size) {
+    using namespace lz_detail;
+
+    auto dst = static_cast<unsigned char*>(out);
+    std::size_t in = 0, at = 0;
+
+    while (in < compressed) {
+        auto token = data[in++];
+
+        std::size_t literals = token >> 4;
+        if (literals == 15 && !read_length(data, compressed, in, literals)) return false;
+        if (literals > compressed - in || literals > size - at) return false;
+
+        if (literals) std::memcpy(dst + at, data + in, literals);
+        in += literals;
+        at += literals;
+
+        //the last sequence ends with its literals
+        if (in == compressed) break;
+
+        if (compressed - in < 2) return false;
+        std::size_t offset = data[in] | data[in + 1] << 8;
+        in += 2;
+
+        std::size_t match = (token & 15) + min_match;
+        if ((token & 15) == 15 && !read_length(data, compressed, in, match)) return false;
+        if (!offset || offset > at || match > size - at) return false;
+
+        //matches may overlap their own output
+        auto from = dst + at - offset;
+        for (std::size_t i = 0; i < match; i++) dst[at + i] = from[i];
+        at += match;
+    }
+
+    return at == size;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "lotus.hpp"
+
+#include <mutex>
+#include <cstdio>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+//=================
+// Forwards
+
+namespace lotus {
+    // hot-set manifest: names of loaded resources with their access counts and load times
+    //
+    // file layout (little endian):
+    //   u32 magic "LTHM", u32 version, u32 count
+    //   entries: u32 accesses, u64 load time (ns), u16 name size, name
+
+    // writes currently loaded resources of the registry to a manifest; returns false on io error
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    bool save_manifest(resource_registry<resource_type, policy, loader_type>&, const char* path);
+
+    // reads a manifest; returns false when the file is missing or malformed
+    bool load_manifest(const char* path, std::vector<resource_info>&);
+
+    // requests every resource listed in the manifest, the slowest to load first, on given number of threads,
+    // and waits until the loads finish; idle (if set) is called while waiting, e.g. to pump a loader pipeline
+    // single_threaded registries are always preloaded on the calling thread
+    // returned handles keep the resources loaded
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    std::vector<resource_handle<resource_type, policy, loader_type>> preload(
+        resource_registry<resource_type, policy, loader_type>&, const std::vector<resource_info>&,
+        unsigned int threads = std::thread::hardware_concurrency(), std::function<void()> idle = nullptr
+    );
+}
+
+//=================
+// Functions
+
+namespace lotus {
+    constexpr std::uint32_t manifest_magic   = 0x4d48544c;  //"LTHM"
+    constexpr std::uint32_t manifest_version = 1;
+}
+
+template<class resource_type, class policy, class loader_type>
+bool lotus::save_manifest(resource_registry<resource_type, policy, loader_type>& reg, const char* path) {
+    auto entries = lotus::loaded_resources(reg);
+
+    auto file = std::fopen(path, "wb");
+    if (!file) return false;
+
+    std::uint32_t header[3] = {manifest_magic, manifest_version, static_cast<std::uint32_t>(entries.size())};
+    bool ok = std::fwrite(header, sizeof(header), 1, file) == 1;
+
+    for (auto& e : entries) {
+        if (!ok) break;
+
+        std::uint32_t accesses = e.accesses;
+        auto size = static_cast<std::uint16_t>(e.name.size() < 0xffff ? e.name.size() : 0xffff);
+
+        ok = std::fwrite(&accesses, sizeof(accesses), 1, file) == 1
+            && std::fwrite(&e.load_time, sizeof(e.load_time), 1, file) == 1
+            && std::fwrite(&size, sizeof(size), 1, file) == 1
+            && std::fwrite(e.name.data(), 1, size, file) == size;
+    }
+
+    return std::fclose(file) == 0 && ok;
+}
+
+inline bool lotus::load_manifest(const char* path, std::vector<resource_info>& out) {
+    auto file = std::fopen(path, "rb");
+    if (!file) return false;
+
+    std::uint32_t header[3];
+    bool ok = std::fread(header, sizeof(header), 1, file) == 1
+        && header[0] == manifest_magic && header[1] == manifest_version;
+
+    for (std::uint32_t i = 0; ok && i < header[2]; i++) {
+        resource_info e;
+        std::uint32_t accesses;
+        std::uint16_t size;
+
+        ok = std::fread(&accesses, sizeof(accesses), 1, file) == 1
+            && std::fread(&e.load_time, sizeof(e.load_time), 1, file) == 1
+            && std::fread(&size, sizeof(size), 1, file) == 1;
+        if (!ok) break;
+
+        e.accesses = accesses;
+        e.name.resize(size);
+        ok = std::fread(&e.name[0], 1, size, file) == size;
+        if (ok) out.push_back(std::move(e));
+    }
+
+    std::fclose(file);
+    return ok;
+}
+
+template<class resource_type, class policy, class loader_type>
+std::vector<lotus::resource_handle<resource_type, policy, loader_type>> lotus::preload(
+    resource_registry<resource_type, policy, loader_type>&   reg,
+    const std::vector<resource_info>&   entries,
+    unsigned int                        threads,
+    std::function<void()>               idle
+) {
+    //expensive loads first so they don't end up as the tail; ties go to the more used resource
+    std::vector<const resource_info*> order;
+    order.reserve(entries.size());
+    for (auto& e : entries) order.push_back(&e);
+
+    std::sort(order.begin(), order.end(), [](const resource_info* a, const resource_info* b) {
+        if (a->load_time != b->load_time) return a->load_time > b->load_time;
+        return a->accesses > b->accesses;
+    });
+
+    std::vector<lotus::resource_handle<resource_type, policy, loader_type>> handles(order.size());
+    std::atomic<std::size_t> next{0};
+
+    auto work = [&] {
+        for (std::size_t i; (i = next.fetch_add(1)) < order.size();)
+            handles[i] = lotus::get(order[i]->name.c_str(), reg);
+    };
+
+    if (threads == 0 || !policy::concurrent) threads = 1;
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; i++) workers.emplace_back(work);
+    work();
+    for (auto& w : workers) w.join();
+
+    //asynchronous loaders may still be working; each pending load counts down once it finishes
+    struct pending_loads {
+        std::mutex              mutex;
+        std::condition_variable done;
+        std::size_t             count = 0;
+    } pending;
+
+    auto finished = [](void* context, bool) {
+        auto p = static_cast<pending_loads*>(context);
+
+        //notified under the mutex, as the waiting thread returns and destroys it once the count drops to zero
+        std::lock_guard<std::mutex> lock(p->mutex);
+        if (!--p->count) p->done.notify_all();
+    };
+
+    for (auto& h : handles) {
+        if (!h.loading()) continue;
+
+        {
+            std::lock_guard<std::mutex> lock(pending.mutex);
+            pending.count++;
+        }
+        lotus::when_ready(h, finished, &pending);
+    }
+
+    std::unique_lock<std::mutex> lock(pending.mutex);
+    if (!idle) pending.done.wait(lock, [&] { return !pending.count; });
+
+    //loads completed by idle (a pumped pipeline) may finish on this thread
+    while (pending.count) {
+        lock.unlock();
+        idle();
+        lock.lock();
+    }
+
+    return handles;
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "lotus.hpp"
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+#if defined(__linux__)
+#define LOTUS_MEMORY_MONITOR 1
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+//=================
+// Forwards
+
+namespace lotus {
+    struct memory_monitor_config {
+        std::string     cgroup;                         //cgroup v2 directory; empty finds the process' own
+        std::string     pressure        = "/proc/pressure/memory";
+        double          high_usage      = 0.85;         //share of memory.max above which budgets shrink
+        double          low_usage       = 0.70;         //share of memory.max below which budgets grow back
+        double          critical_usage  = 0.95;         //share of memory.max at which every idle resource is evicted
+        double          stall           = 5;            //"some" avg10 stall percentage counting as pressure
+        std::uint64_t   trigger_us      = 100000;       //psi trigger: stall time per window that wakes the monitor
+        std::uint64_t   window_us       = 2000000;      //unprivileged triggers need a multiple of 2s
+        unsigned int    interval_ms     = 1000;         //checks when no trigger fires
+        double          shrink          = 0.5;          //budget scale multiplier per check under pressure
+        double          grow            = 0.1;          //budget scale added per relaxed check
+    };
+
+    // last reading of a memory monitor
+    struct memory_status {
+        std::uint64_t   limit;      //memory.max in bytes; 0 when unlimited or unknown
+        std::uint64_t   usage;      //memory.current minus reclaimable inactive file cache; 0 when unknown
+        double          some_avg10; //percentage of the last 10s some tasks stalled on memory
+        double          full_avg10; //percentage of the last 10s all tasks stalled on memory
+        double          scale;      //share of the watched budgets currently granted, 0..1
+        std::uint64_t   triggers;   //psi trigger wakeups so far
+    };
+
+    // shrinks the resident budgets of watched registries as the process' cgroup (v2) nears memory.max or
+    // memory pressure stall information reports stalls, evicting idle resources before the kernel starts reclaim
+    // stalls or the oom killer; budgets grow back gradually once pressure eases
+    //
+    // a psi trigger on the pressure file wakes the monitor as soon as stalls exceed trigger_us per window; when the
+    // kernel refuses the trigger the monitor falls back to reading the file every interval_ms
+    // does nothing on platforms other than linux
+    //
+    // destroy before the watched registries
+    struct memory_monitor;
+}
+
+//=================
+// Memory Monitor
+
+struct lotus::memory_monitor {
+private:
+    struct watched {
+        std::function<void(std::uint64_t)>  set_budget;
+        std::uint64_t                       budget;
+    };
+
+    memory_monitor_config   config;
+
+    std::mutex              mutex;      //guards everything below but the descriptors
+    std::vector<watched>    registries;
+    memory_status           last = {};
+    bool                    triggered = false;
+
+#if defined(LOTUS_MEMORY_MONITOR)
+    int                     trigger_fd = -1;
+    int                     wake_fd    = -1;
+    std::thread             worker;
+#endif
+
+    //reads a whole small file; returns false when it can't be opened
+    static bool read_file(const std::string& path, std::string& out) {
+        auto file = std::fopen(path.c_str(), "r");
+        if (!file) return false;
+
+        char buffer[4096];
+        std::size_t n;
+        out.clear();
+        while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) out.append(buffer, n);
+
+        std::fclose(file);
+        return true;
+    }
+
+    //value following key in a "key value" or "key=value" listing; 0 when missing
+    static double field(const std::string& text, const char* key) {
+        auto pos = text.find(key);
+        return pos == std::string::npos ? 0 : std::atof(text.c_str() + pos + std::strlen(key));
+    }
+
+    //cgroup v2 directory of the process: the "0::" line of /proc/self/cgroup, under the unified hierarchy mount
+    static std::string own_cgroup() {
+        std::string text;
+        if (!read_file("/proc/self/cgroup", text)) return {};
+
+        auto pos = text.find("0::");
+        if (pos == std::string::npos) return {};
+
+        auto end  = text.find('\n', pos);
+        auto path = text.substr(pos + 3, end == std::string::npos ? std::string::npos : end - pos - 3);
+
+        //hybrid setups mount the unified hierarchy apart from the v1 controllers
+        std::string probe;
+        for (auto root : {"/sys/fs/cgroup", "/sys/fs/cgroup/unified"})
+            if (read_file(root + path + "/memory.current", probe)) return root + path;
+        return {};
+    }
+
+    //reads the cgroup and pressure files into status, leaving scale and triggers
+    void read_status(memory_status& status) const {
+        std::string text;
+
+        status.limit = status.usage = 0;
+        if (!config.cgroup.empty()) {
+            //"max" reads as 0, meaning unlimited
+            if (read_file(config.cgroup + "/memory.max", text)) status.limit = std::strtoull(text.c_str(), nullptr, 10);
+
+            if (read_file(config.cgroup + "/memory.current", text)) {
+                std::uint64_t current = std::strtoull(text.c_str(), nullptr, 10);
+
+                //inactive file cache is reclaimed without stalls, so it doesn't count as usage
+                std::uint64_t inactive = 0;
+                if (read_file(config.cgroup + "/memory.stat", text))
+                    inactive = static_cast<std::uint64_t>(field(text, "inactive_file "));
+                status.usage = current > inactive ? current - inactive : 0;
+            }
+        }
+
+        status.some_avg10 = status.full_avg10 = 0;
+        if (read_file(config.pressure, text)) {
+            auto full = text.find("full");
+            status.some_avg10 = field(text.substr(0, full), "avg10=");
+            if (full != std::string::npos) status.full_avg10 = field(text.substr(full), "avg10=");
+        }
+    }
+
+    //call under mutex
+    void apply(double scale) {
+        if (scale == last.scale) return;
+        last.scale = scale;
+
+        for (auto& r : registries) r.set_budget(static_cast<std::uint64_t>(r.budget * scale));
+    }
+
+#if defined(LOTUS_MEMORY_MONITOR)
+    void work() {
+        for (;;) {
+            pollfd fds[2] = {{wake_fd, POLLIN, 0}, {trigger_fd, POLLPRI, 0}};
+            int n = ::poll(fds, trigger_fd >= 0 ? 2 : 1, static_cast<int>(config.interval_ms));
+            if (n < 0 && errno != EINTR) return;
+
+            if (fds[0].revents) return;
+
+            if (trigger_fd >= 0 && fds[1].revents) {
+                //the cgroup holding the trigger went away; keep checking at the interval
+                if (fds[1].revents & POLLERR) {
+                    ::close(trigger_fd);
+                    trigger_fd = -1;
+                }
+                else {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    triggered = true;
+                    last.triggers++;
+                }
+            }
+
+            update();
+        }
+    }
+#endif
+
+public:
+    memory_monitor(const memory_monitor_config& _config = {}) : config(_config) {
+        last.scale = 1;
+
+#if defined(LOTUS_MEMORY_MONITOR)
+        if (config.cgroup.empty()) config.cgroup = own_cgroup();
+
+        trigger_fd = ::open(config.pressure.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (trigger_fd >= 0) {
+            char trigger[64];
+            std::snprintf(trigger, sizeof(trigger), "some %llu %llu",
+                static_cast<unsigned long long>(config.trigger_us), static_cast<unsigned long long>(config.window_us));
+
+            if (::write(trigger_fd, trigger, std::strlen(trigger) + 1) < 0) {
+                ::close(trigger_fd);
+                trigger_fd = -1;
+            }
+        }
+
+        wake_fd = ::eventfd(0, EFD_CLOEXEC);
+        if (wake_fd >= 0) worker = std::thread([this] { work(); });
+#endif
+    }
+
+    memory_monitor(const memory_monitor&) = delete;
+    memory_monitor& operator=(const memory_monitor&) = delete;
+
+    ~memory_monitor() {
+#if defined(LOTUS_MEMORY_MONITOR)
+        if (worker.joinable()) {
+            std::uint64_t one = 1;
+            (void)!::write(wake_fd, &one, sizeof(one));
+            worker.join();
+        }
+
+        if (trigger_fd >= 0) ::close(trigger_fd);
+        if (wake_fd >= 0)    ::close(wake_fd);
+#endif
+    }
+
+    // puts the registry's resident budget under the monitor: it is set to budget scaled by the current pressure
+    // thread safe
+    template<class resource_type, class policy, class loader_type>
+    void watch(resource_registry<resource_type, policy, loader_type>& reg, std::uint64_t budget) {
+        auto set_budget = [&reg](std::uint64_t bytes) {
+            lotus::set_resident_budget(reg, bytes);
+        };
+
+        std::lock_guard<std::mutex> lock(mutex);
+        registries.push_back({set_budget, budget});
+        set_budget(static_cast<std::uint64_t>(budget * last.scale));
+    }
+
+    // reads the cgroup and pressure files and adjusts the budgets right away; the monitor calls it on every wakeup
+    // thread safe
+    void update() {
+        memory_status status;
+        read_status(status);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        bool critical = status.limit && status.usage >= config.critical_usage * status.limit;
+        bool high     = status.limit && status.usage >= config.high_usage * status.limit;
+        bool low      = !status.limit || status.usage < config.low_usage * status.limit;
+        bool stalling = status.some_avg10 >= config.stall || triggered;
+
+        status.scale    = last.scale;
+        status.triggers = last.triggers;
+        last = status;
+        triggered = false;
+
+        if (critical)               apply(0);
+        else if (high || stalling)  apply(last.scale * config.shrink < 0.01 ? 0 : last.scale * config.shrink);
+        else if (low)               apply(std::min(1.0, last.scale + config.grow));
+    }
+
+    // last reading
+    // thread safe
+    memory_status status() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return last;
+    }
+};
@@ -0,0 +1,366 @@
+#pragma once
+
+#include "lotus.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//=================
+// Forwards
+
+namespace lotus {
+    // lotus pack layout (little endian):
+    //   pack_header
+    //   blobs, each aligned to pack_header::alignment
+    //   pack_entry[count], sorted by (hash, name)
+    //   names, not null terminated
+    struct pack_header;
+    struct pack_entry;
+
+    // resource pointing straight into a mapped pack
+    // stays valid as long as the pack_reader it came from
+    struct pack_blob {
+        const unsigned char*    data;
+        std::size_t             size;
+    };
+
+    // writes a pack; blobs are laid out in the order they are added
+    struct pack_writer;
+
+    // memory maps a pack and looks blobs up by name
+    struct pack_reader;
+
+    // loader owning a mapped pack; serves blobs by name, unloading a blob only drops the reference
+    struct pack_loader;
+
+    // registry serving blobs from a mapped pack through pack_loader
+    struct pack_registry;
+
+    // 64-bit fnv-1a hash used by the pack index; the same as hashed_keys
+    std::uint64_t pack_hash(const char*, std::size_t);
+}
+
+//=================
+// Format
+
+struct lotus::pack_header {
+    static constexpr std::uint32_t magic_value   = 0x4b50544c;   //"LTPK"
+    static constexpr std::uint32_t version_value = 1;
+
+    std::uint32_t   magic;
+    std::uint32_t   version;
+    std::uint32_t   count;
+    std::uint32_t   alignment;
+    std::uint64_t   index_offset;
+    std::uint64_t   names_offset;
+};
+
+struct lotus::pack_entry {
+    std::uint64_t   hash;
+    std::uint64_t   offset;
+    std::uint64_t   size;
+    std::uint32_t   name_offset;
+    std::uint32_t   name_size;
+};
+
+inline std::uint64_t lotus::pack_hash(const char* name, std::size_t size) {
+    return detail::fnv1a(name, size);
+}
+
+//=================
+// Pack Writer
+
+struct lotus::pack_writer {
+private:
+    std::FILE*                  file = nullptr;
+    std::uint32_t               alignment;
+    std::uint64_t               offset = 0;
+    std::vector<pack_entry>     entries;
+    std::string                 names;
+
+    bool pad_to(std::uint64_t target) {
+        static const unsigned char zeros[256] = {};
+        while (offset < target) {
+            auto chunk = static_cast<std::size_t>(std::min<std::uint64_t>(target - offset, sizeof(zeros)));
+            if (std::fwrite(zeros, 1, chunk, file) != chunk) return false;
+            offset += chunk;
+        }
+        return true;
+    }
+
+public:
+    // alignment must be a power of two; use the page size to allow mapping single blobs
+    pack_writer(const char* path, std::uint32_t _alignment = 64) : alignment(_alignment ? _alignment : 1) {
+        file = std::fopen(path, "wb");
+        if (file && !pad_to(sizeof(pack_header))) {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+    pack_writer(const pack_writer&) = delete;
+    pack_writer& operator=(const pack_writer&) = delete;
+
+    ~pack_writer() {
+        if (file) std::fclose(file);
+    }
+
+    // returns whether the output file could be opened
+    bool good() const {
+        return file != nullptr;
+    }
+
+    // appends blob under given name
+    bool add(const char* name, const void* data, std::size_t size) {
+        if (!file) return false;
+
+        auto aligned = (offset + alignment - 1) / alignment * alignment;
+        if (!pad_to(aligned)) return false;
+        if (size && std::fwrite(data, 1, size, file) != size) return false;
+
+        auto name_size = std::strlen(name);
+        entries.push_back({
+            pack_hash(name, name_size), aligned, size,
+            static_cast<std::uint32_t>(names.size()), static_cast<std::uint32_t>(name_size)
+        });
+        names.append(name, name_size);
+
+        offset += size;
+        return true;
+    }
+
+    // writes the index and closes the file; returns false on io error
+    bool finish() {
+        if (!file) return false;
+
+        std::sort(entries.begin(), entries.end(), [this](const pack_entry& a, const pack_entry& b) {
+            if (a.hash != b.hash) return a.hash < b.hash;
+            return names.compare(a.name_offset, a.name_size, names, b.name_offset, b.name_size) < 0;
+        });
+
+        pack_header header;
+        header.magic        = pack_header::magic_value;
+        header.version      = pack_header::version_value;
+        header.count        = static_cast<std::uint32_t>(entries.size());
+        header.alignment    = alignment;
+        header.index_offset = (offset + alignof(pack_entry) - 1) / alignof(pack_entry) * alignof(pack_entry);
+        header.names_offset = header.index_offset + entries.size() * sizeof(pack_entry);
+
+        bool ok = pad_to(header.index_offset)
+            && std::fwrite(entries.data(), sizeof(pack_entry), entries.size(), file) == entries.size()
+            && std::fwrite(names.data(), 1, names.size(), file) == names.size()
+            && std::fseek(file, 0, SEEK_SET) == 0
+            && std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+        ok = std::fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+};
+
+//=================
+// Pack Reader
+
+struct lotus::pack_reader {
+private:
+    const unsigned char*    base = nullptr;
+    std::size_t             size = 0;
+    const pack_header*      header = nullptr;
+    const pack_entry*       entries = nullptr;
+    const char*             names = nullptr;
+
+#if defined(_WIN32)
+    HANDLE                  file_handle = INVALID_HANDLE_VALUE;
+    HANDLE                  mapping = nullptr;
+#endif
+
+    bool map(const char* path) {
+#if defined(_WIN32)
+        file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) return false;
+        size = static_cast<std::size_t>(file_size.QuadPart);
+
+        mapping = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return false;
+
+        base = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        return base != nullptr;
+#else
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size = static_cast<std::size_t>(st.st_size);
+
+        //the mapping keeps the file alive after closing the descriptor
+        auto mapped = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) return false;
+
+        base = static_cast<const unsigned char*>(mapped);
+        return true;
+#endif
+    }
+
+    void unmap() {
+#if defined(_WIN32)
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+        mapping = nullptr;
+        file_handle = INVALID_HANDLE_VALUE;
+#else
+        if (base) ::munmap(const_cast<unsigned char*>(base), size);
+#endif
+        base = nullptr;
+        header = nullptr;
+    }
+
+    bool validate() {
+        if (size < sizeof(pack_header)) return false;
+
+        header = reinterpret_cast<const pack_header*>(base);
+        if (header->magic != pack_header::magic_value || header->version != pack_header::version_value) return false;
+
+        //bounds are checked by subtracting from the size, so offsets of a crafted file can't wrap past it
+        std::uint64_t index_offset = header->index_offset, count = header->count;
+        if (index_offset % alignof(pack_entry) || index_offset > size || count > (size - index_offset) / sizeof(pack_entry)) return false;
+        if (header->names_offset != index_offset + count * sizeof(pack_entry)) return false;
+
+        entries = reinterpret_cast<const pack_entry*>(base + header->index_offset);
+        names   = reinterpret_cast<const char*>(base + header->names_offset);
+
+        std::uint64_t names_size = size - header->names_offset;
+        for (std::uint32_t i = 0; i < header->count; i++) {
+            auto& e = entries[i];
+            if (e.offset > size || e.size > size - e.offset) return false;
+            if (e.name_offset > names_size || e.name_size > names_size - e.name_offset) return false;
+        }
+        return true;
+    }
+
+public:
+    pack_reader() {}
+
+    pack_reader(const char* path) {
+        open(path);
+    }
+
+    pack_reader(const pack_reader&) = delete;
+    pack_reader& operator=(const pack_reader&) = delete;
+
+    ~pack_reader() {
+        unmap();
+    }
+
+    // maps the pack; returns false when it can't be opened or is malformed
+    bool open(const char* path) {
+        unmap();
+        if (map(path) && validate()) return true;
+
+        unmap();
+        return false;
+    }
+
+    // returns whether a pack is mapped
+    bool good() const {
+        return header != nullptr;
+    }
+
+    // number of blobs in the pack
+    std::size_t count() const {
+        return header ? header->count : 0;
+    }
+
+    // looks the blob up in the index; returns false when the pack has no such name
+    bool find(const char* name, pack_blob& blob) const {
+        if (!header) return false;
+
+        auto name_size = std::strlen(name);
+        auto hash = pack_hash(name, name_size);
+
+        auto end = entries + header->count;
+        auto itr = std::lower_bound(entries, end, hash, [](const pack_entry& e, std::uint64_t h) { return e.hash < h; });
+
+        for (; itr != end && itr->hash == hash; ++itr) {
+            if (itr->name_size != name_size || std::memcmp(names + itr->name_offset, name, name_size) != 0) continue;
+
+            blob.data = base + itr->offset;
+            blob.size = static_cast<std::size_t>(itr->size);
+            return true;
+        }
+        return false;
+    }
+
+    // name of the i-th index entry
+    std::string name(std::size_t i) const {
+        return std::string(names + entries[i].name_offset, entries[i].name_size);
+    }
+};
+
+//=================
+// Pack Registry
+
+struct lotus::pack_loader {
+private:
+    lotus::pack_reader reader;
+
+    friend struct lotus::pack_registry;
+
+public:
+    pack_loader() {}
+
+    pack_loader(const char* path) : reader(path) {}
+
+    template<class registry_type, class token_type>
+    void load(const char* name, registry_type&, token_type token) {
+        pack_blob blob;
+        if (!reader.find(name, blob)) return lotus::fail(token, "not in pack");
+
+        lotus::complete(token, new pack_blob(blob));
+    }
+
+    void unload(pack_blob* blob) {
+        delete blob;
+    }
+};
+
+struct lotus::pack_registry : lotus::resource_registry<lotus::pack_blob, lotus::multi_threaded, lotus::pack_loader> {
+public:
+    pack_registry() {}
+
+    pack_registry(const char* path) : resource_registry(path) {}
+
+    // unloads every blob, including those kept loaded by a resident budget, then maps the pack
+    // must not be called while handles to blobs are held
+    bool open(const char* path) {
+        //loaded blobs point into the old mapping
+        lotus::unload_registry(*this);
+        return loader().reader.open(path);
+    }
+
+    const lotus::pack_reader& pack() const {
+        return loader().reader;
+    }
+};
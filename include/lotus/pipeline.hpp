@@ -0,0 +1,201 @@
+#pragma once
+
+#include "lotus.hpp"
+#include "stage_pool.hpp"
+#include "file_reader.hpp"
+
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+//=================
+// Forwards
+
+namespace lotus {
+    // loader split into read, decode and finalize stages
+    // read and decode run on their own pools; finalize runs on the thread calling pump()
+    // policy and loader_type must match the registry the pipeline loads into
+    template<class resource_type, class policy = multi_threaded, class loader_type = function_loader<resource_type, policy>>
+    struct loader_pipeline;
+
+    // reads raw bytes of the named resource; returns false on failure, which fails the load (see lotus::fail)
+    using read_stage = bool(*)(const char*, std::vector<unsigned char>&);
+
+    // maps resource name to the path of its file; used instead of read_stage with a file_reader
+    using locate_stage = std::string(*)(const char*);
+
+    // turns raw bytes into the resource; returns nullptr on failure, which fails the load
+    template<class resource_type>
+    using decode_stage = resource_type*(*)(const char*, std::vector<unsigned char>&);
+
+    // prepares decoded resource on the owner thread (e.g. uploads it to the gpu)
+    template<class resource_type>
+    using finalize_stage = void(*)(resource_type*);
+
+    // sizes of pipeline pools and queues
+    struct pipeline_config {
+        unsigned int    io_threads      = 2;
+        std::size_t     io_queue        = 64;
+        unsigned int    decode_threads  = std::thread::hardware_concurrency();
+        std::size_t     decode_queue    = 64;
+    };
+}
+
+//=================
+// Loader Pipeline
+
+template<class resource_type, class policy, class loader_type>
+struct lotus::loader_pipeline {
+private:
+    using token_type = lotus::load_token<resource_type, policy, loader_type>;
+
+    struct finalize_job {
+        token_type      token;
+        resource_type*  object;
+    };
+
+    read_stage                          read;
+    lotus::file_reader*                 reader = nullptr;
+    locate_stage                        locate = nullptr;
+    decode_stage<resource_type>         decode;
+    finalize_stage<resource_type>       finalize;
+
+    //reads issued to the reader and not yet handed to the decode pool
+    std::mutex                          reads_mutex;
+    std::condition_variable             reads_done;
+    std::size_t                         reads_inflight = 0;
+
+    //owner queue is unbounded: the owner thread may be the one blocked in "request"
+    std::mutex                          owner_mutex;
+    std::deque<finalize_job>            owner_jobs;
+
+    std::unique_ptr<lotus::stage_pool>  io_pool;        //only without a reader
+    lotus::stage_pool                   decode_pool;
+
+    void run_decode(const std::string& name, token_type token, std::vector<unsigned char>& bytes) {
+        if (token.cancelled()) return;
+
+        auto object = decode(name.c_str(), bytes);
+        if (!object) return lotus::fail(token, "decode failed");
+
+        if (!finalize) {
+            lotus::complete(token, object);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(owner_mutex);
+        owner_jobs.push_back({token, object});
+    }
+
+    void run_read(const std::string& name, token_type token) {
+        if (token.cancelled()) return;
+
+        std::vector<unsigned char> bytes;
+        if (!read(name.c_str(), bytes)) return lotus::fail(token, "read failed");
+
+        if (token.cancelled()) return;
+
+        push_decode(name, token, std::move(bytes), true);
+    }
+
+    //reader threads post, so a decode thread requesting a read can't wait on a reader waiting on the decode queue
+    void push_decode(const std::string& name, token_type token, std::vector<unsigned char>&& bytes, bool wait) {
+        auto shared_bytes = std::make_shared<std::vector<unsigned char>>(std::move(bytes));
+        auto job = [this, name, token, shared_bytes] {
+            run_decode(name, token, *shared_bytes);
+        };
+
+        if (wait) decode_pool.push(std::move(job));
+        else      decode_pool.post(std::move(job));
+    }
+
+    void request_file(const char* name, token_type token) {
+        std::unique_lock<std::mutex> lock(reads_mutex);
+        reads_inflight++;
+        lock.unlock();
+
+        std::string owned = name;
+        reader->read(locate(name), [this, owned, token](std::vector<unsigned char>&& bytes, int err) {
+            if (err) lotus::fail(token, std::strerror(err));
+            else if (!token.cancelled()) push_decode(owned, token, std::move(bytes), false);
+
+            std::lock_guard<std::mutex> lock(reads_mutex);
+            if (--reads_inflight == 0) reads_done.notify_all();
+        });
+    }
+
+public:
+    // finalize may be nullptr; the resource is then published right after decoding
+    loader_pipeline(
+        read_stage                      _read,
+        decode_stage<resource_type>     _decode,
+        finalize_stage<resource_type>   _finalize,
+        const pipeline_config&          config = {}
+    ) : read(_read), decode(_decode), finalize(_finalize),
+        io_pool(new lotus::stage_pool(config.io_threads, config.io_queue)),
+        decode_pool(config.decode_threads, config.decode_queue) {};
+
+    // reads whole files through given reader instead of a read stage; no io pool is started, so its settings are unused
+    // the reader completes straight into the decode pool
+    loader_pipeline(
+        lotus::file_reader&             _reader,
+        locate_stage                    _locate,
+        decode_stage<resource_type>     _decode,
+        finalize_stage<resource_type>   _finalize,
+        const pipeline_config&          config = {}
+    ) : read(nullptr), reader(&_reader), locate(_locate), decode(_decode), finalize(_finalize),
+        decode_pool(config.decode_threads, config.decode_queue) {};
+
+    // must be destroyed before the registries it loads into
+    // resources still waiting for finalize are unloaded
+    ~loader_pipeline() {
+        //io jobs push into the decode pool, so stop it first
+        if (io_pool) io_pool->stop();
+
+        std::unique_lock<std::mutex> lock(reads_mutex);
+        reads_done.wait(lock, [this] { return reads_inflight == 0; });
+        lock.unlock();
+
+        decode_pool.stop();
+
+        //abandoning cancels the token, so complete unloads the object
+        for (auto& job : owner_jobs) {
+            lotus::abandon(job.token);
+            lotus::complete(job.token, job.object);
+        }
+    }
+
+    // starts the load; call from the registry request callback
+    // blocks while the io queue is full, except on the pipeline's own threads: loads requested there (e.g. by
+    // a dependency continuation or a reload cascade running where a dependency is published) are queued past it
+    void request(const char* name, token_type token) {
+        if (reader) return request_file(name, token);
+
+        std::string owned = name;
+        auto job = [this, owned, token] { run_read(owned, token); };
+
+        if (io_pool->on_worker() || decode_pool.on_worker()) io_pool->post(std::move(job));
+        else                                                 io_pool->push(std::move(job));
+    }
+
+    // runs up to max_jobs pending finalize stages on the calling thread
+    // returns the number of finalized resources
+    std::size_t pump(std::size_t max_jobs = SIZE_MAX) {
+        std::size_t done = 0;
+
+        while (done < max_jobs) {
+            std::unique_lock<std::mutex> lock(owner_mutex);
+            if (owner_jobs.empty()) break;
+
+            auto job = owner_jobs.front();
+            owner_jobs.pop_front();
+            lock.unlock();
+
+            //cancelled objects are handed straight to complete, which unloads them
+            if (!job.token.cancelled()) finalize(job.object);
+            if (lotus::complete(job.token, job.object)) done++;
+        }
+
+        return done;
+    }
+};
@@ -0,0 +1,375 @@
+#pragma once
+
+// compile-time policies of resource_registry: lock, index, key and reference count types
+// included by lotus.hpp
+//
+// a policy is a struct with the members below; registry_policy composes one from building blocks, and
+// a custom policy may derive from it and override single members
+//
+//   static constexpr bool concurrent               whether registry and handles are shared between threads
+//   mutex_type                                     lock of the registry index
+//   template<class T> atomic                       std::atomic compatible type of states and load tickets
+//   refcount_type                                  handle counter with acquire(), release() (true when last) and load()
+//   keys                                           key type of the index, built from resource names
+//   template<class K, class V, class H> map_type   index container
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+//=================
+// Forwards
+
+namespace lotus {
+    // mutex spinning briefly before yielding to other threads; for short critical sections under light contention
+    // thread safe
+    struct spin_mutex;
+
+    // mutex doing nothing; for registries used by a single thread
+    struct null_mutex;
+
+    // atomic reference count
+    // thread safe
+    struct atomic_refcount;
+
+    // plain integer reference count; for registries used by a single thread
+    struct plain_refcount;
+
+    // indexes resources by their names; lookups don't allocate (default)
+    struct string_keys;
+
+    // indexes resources by 64-bit hashes of their names, so the index holds no strings and compares integers
+    // names with equal hashes share an entry; use only when names are known not to collide (e.g. pack contents)
+    struct hashed_keys;
+
+    // open addressing hash map with linear probing; supports the subset of std::unordered_map used by the registry
+    // entries are never erased
+    template<class key_type, class value_type, class hash_type>
+    struct flat_map;
+
+    // index selectors
+    struct unordered_index;     //std::unordered_map (default)
+    struct flat_index;          //lotus::flat_map; fewer allocations and cache misses per lookup
+
+    // policy composed from a lock, key, index and refcount types
+    template<
+        class mutex    = std::mutex,
+        class key      = string_keys,
+        class index    = unordered_index,
+        class refcount = atomic_refcount
+    >
+    struct registry_policy;
+
+    // registry and handles may be used from any thread (default)
+    struct multi_threaded;
+
+    // registry, its handles and loads are used from a single thread only
+    // the mutex compiles to nothing and reference counts, states and statistics are plain integers
+    struct single_threaded;
+
+    namespace detail {
+        // 64-bit fnv-1a hash of a name; shared by hashed_keys, pack indices and the prefetcher
+        std::uint64_t fnv1a(const char*, std::size_t);
+    }
+}
+
+//=================
+// Locks
+
+struct lotus::spin_mutex {
+private:
+    std::atomic<bool> locked{false};
+
+public:
+    void lock() {
+        for (unsigned int spins = 0; !try_lock(); spins++) {
+            //wait on a plain load so the cache line isn't bounced between waiting cores
+            while (locked.load(std::memory_order_relaxed)) {
+                if (++spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+                    __builtin_ia32_pause();
+#endif
+                }
+                else std::this_thread::yield();
+            }
+        }
+    }
+
+    bool try_lock() {
+        return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+};
+
+struct lotus::null_mutex {
+    void lock() {}
+    bool try_lock() { return true; }
+    void unlock() {}
+};
+
+//=================
+// Reference Counts
+
+struct lotus::atomic_refcount {
+private:
+    std::atomic<unsigned int> value{0};
+
+public:
+    //new references come from existing ones or are taken under the registry mutex, so no ordering is needed
+    void acquire() {
+        value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // returns whether the last reference was released
+    bool release() {
+        return value.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    unsigned int load() const {
+        return value.load(std::memory_order_acquire);
+    }
+};
+
+struct lotus::plain_refcount {
+private:
+    unsigned int value = 0;
+
+public:
+    void acquire() {
+        value++;
+    }
+
+    // returns whether the last reference was released
+    bool release() {
+        return --value == 0;
+    }
+
+    unsigned int load() const {
+        return value;
+    }
+};
+
+//=================
+// Keys
+
+inline std::uint64_t lotus::detail::fnv1a(const char* name, std::size_t size) {
+    std::uint64_t h = 0xcbf29ce484222325ull;
+    for (std::size_t i = 0; i < size; i++) {
+        h ^= static_cast<unsigned char>(name[i]);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+struct lotus::string_keys {
+    //stored keys view the name owned by the registry entry
+    using key_type = std::string_view;
+    using hash     = std::hash<std::string_view>;
+
+    static key_type make(const char* name) {
+        return name;
+    }
+
+    static key_type make(const std::string& name) {
+        return name;
+    }
+};
+
+struct lotus::hashed_keys {
+    using key_type = std::uint64_t;
+
+    //fnv-1a output is already well mixed
+    struct hash {
+        std::size_t operator()(std::uint64_t key) const {
+            return static_cast<std::size_t>(key);
+        }
+    };
+
+    static key_type make(const char* name) {
+        return detail::fnv1a(name, std::strlen(name));
+    }
+
+    static key_type make(const std::string& name) {
+        return detail::fnv1a(name.data(), name.size());
+    }
+};
+
+//=================
+// Flat Map
+
+template<class key_type, class value_type, class hash_type>
+struct lotus::flat_map {
+private:
+    using slot = std::pair<key_type, value_type>;
+
+    std::vector<slot>           slots;
+    std::vector<unsigned char>  used;
+    std::size_t                 count = 0;
+    unsigned int                shift = 64;
+    hash_type                   hasher;
+
+    //fibonacci hashing spreads weak hashes over the table
+    std::size_t home(const key_type& key) const {
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(hasher(key)) * 0x9e3779b97f4a7c15ull) >> shift);
+    }
+
+    std::size_t probe(const key_type& key) const {
+        auto mask = slots.size() - 1;
+        auto i = home(key);
+        while (used[i] && !(slots[i].first == key)) i = (i + 1) & mask;
+        return i;
+    }
+
+    void grow() {
+        std::vector<slot> old_slots(slots.size() ? slots.size() * 2 : 16);
+        std::vector<unsigned char> old_used(old_slots.size(), 0);
+        old_slots.swap(slots);
+        old_used.swap(used);
+
+        shift = 64;
+        for (auto n = slots.size(); n > 1; n >>= 1) shift--;
+
+        for (std::size_t i = 0; i < old_slots.size(); i++) {
+            if (!old_used[i]) continue;
+
+            auto j = probe(old_slots[i].first);
+            slots[j] = std::move(old_slots[i]);
+            used[j] = 1;
+        }
+    }
+
+public:
+    struct iterator {
+        flat_map*   map;
+        std::size_t index;
+
+        slot& operator*() const { return map->slots[index]; }
+        slot* operator->() const { return &map->slots[index]; }
+
+        iterator& operator++() {
+            while (++index < map->slots.size() && !map->used[index]) {}
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return index == other.index; }
+        bool operator!=(const iterator& other) const { return index != other.index; }
+    };
+
+    iterator begin() {
+        iterator itr{this, 0};
+        if (!slots.empty() && !used[0]) ++itr;
+        return slots.empty() ? end() : itr;
+    }
+
+    iterator end() {
+        return {this, slots.size()};
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    iterator find(const key_type& key) {
+        if (slots.empty()) return end();
+
+        auto i = probe(key);
+        return used[i] ? iterator{this, i} : end();
+    }
+
+    std::pair<iterator, bool> insert(slot&& entry) {
+        auto existing = find(entry.first);
+        if (existing != end()) return {existing, false};
+
+        //load factor stays at or below 3/4
+        if (4 * (count + 1) > 3 * slots.size()) grow();
+
+        auto i = probe(entry.first);
+        slots[i] = std::move(entry);
+        used[i] = 1;
+        count++;
+        return {iterator{this, i}, true};
+    }
+};
+
+//=================
+// Policies
+
+struct lotus::unordered_index {
+    template<class key_type, class value_type, class hash_type>
+    using type = std::unordered_map<key_type, value_type, hash_type>;
+};
+
+struct lotus::flat_index {
+    template<class key_type, class value_type, class hash_type>
+    using type = lotus::flat_map<key_type, value_type, hash_type>;
+};
+
+template<class mutex, class key, class index, class refcount>
+struct lotus::registry_policy {
+    static constexpr bool concurrent = true;
+
+    using mutex_type    = mutex;
+    using refcount_type = refcount;
+    using keys          = key;
+
+    template<class T>
+    using atomic = std::atomic<T>;
+
+    template<class key_type, class value_type, class hash_type>
+    using map_type = typename index::template type<key_type, value_type, hash_type>;
+};
+
+struct lotus::multi_threaded : lotus::registry_policy<> {};
+
+struct lotus::single_threaded : lotus::registry_policy<null_mutex, string_keys, unordered_index, plain_refcount> {
+    static constexpr bool concurrent = false;
+
+    // plain value with the subset of std::atomic interface used by the registry
+    template<class T>
+    struct atomic {
+        T value;
+
+        atomic() {}
+        atomic(T _value) : value(_value) {}
+
+        T load(std::memory_order = std::memory_order_seq_cst) const {
+            return value;
+        }
+
+        void store(T desired, std::memory_order = std::memory_order_seq_cst) {
+            value = desired;
+        }
+
+        T fetch_add(T n, std::memory_order = std::memory_order_seq_cst) {
+            T old = value;
+            value = old + n;
+            return old;
+        }
+
+        T fetch_sub(T n, std::memory_order = std::memory_order_seq_cst) {
+            T old = value;
+            value = old - n;
+            return old;
+        }
+
+        bool compare_exchange_strong(T& expected, T desired, std::memory_order = std::memory_order_seq_cst) {
+            if (value == expected) {
+                value = desired;
+                return true;
+            }
+            expected = value;
+            return false;
+        }
+    };
+};
@@ -0,0 +1,345 @@
+#pragma once
+
+#include "lotus.hpp"
+
+#include <list>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
+
+//=================
+// Forwards
+
+namespace lotus {
+    // sizes and thresholds of a prefetcher
+    struct prefetch_config {
+        std::size_t     rows            = 4096;     //predecessors tracked; memory is bounded by rows * successors
+        double          min_confidence  = 0.3;      //share of the predecessor's transitions a successor needs
+        unsigned int    min_count       = 2;        //times a successor must have followed its predecessor
+        unsigned int    max_inflight    = 4;        //prefetch loads in flight at once
+        std::size_t     max_held        = 256;      //prefetched resources kept loaded until used
+        std::size_t     queue           = 64;       //pending predictions; more are dropped
+    };
+
+    // counters of a prefetcher
+    struct prefetch_stats {
+        std::uint64_t   predictions;    //successors predicted and queued
+        std::uint64_t   dropped;        //predictions dropped because the queue was full
+        std::uint64_t   issued;         //prefetches requested from the registry
+        std::uint64_t   hits;           //prefetched resources requested by "get" while held
+        std::uint64_t   wasted;         //prefetched resources let go without any "get"
+
+        // share of issued prefetches that were used
+        double hit_rate() const {
+            return issued ? static_cast<double>(hits) / issued : 0;
+        }
+    };
+
+    // learns which resources follow each other in "get" calls of a thread and loads likely successors
+    // in the background
+    //
+    // successor counts live in a fixed table of rows, each holding a few successors of one predecessor; rows and
+    // successors are replaced by frequency, so memory stays bounded; prefetched resources are held until a "get"
+    // uses them or max_held newer ones push them out; a used resource is then kept by the caller's handles only
+    //
+    // adds an access hook to the registry; create before the registry is shared between threads and
+    // destroy before the registry
+    template<class resource_type, class policy = multi_threaded, class loader_type = function_loader<resource_type, policy>>
+    struct prefetcher;
+}
+
+//=================
+// Prefetcher
+
+template<class resource_type, class policy, class loader_type>
+struct lotus::prefetcher {
+private:
+    using registry = lotus::resource_registry<resource_type, policy, loader_type>;
+    using handle   = lotus::resource_handle<resource_type, policy, loader_type>;
+
+    static constexpr unsigned int successors = 4;
+
+    struct successor {
+        std::string     name;
+        std::uint32_t   count = 0;
+    };
+
+    struct row {
+        std::uint64_t   key   = 0;
+        std::uint32_t   total = 0;
+        successor       next[successors];
+    };
+
+    struct held_resource {
+        handle                                  resource;
+        std::list<std::string>::iterator        order;
+    };
+
+    registry&                                       reg;
+    prefetch_config                                 config;
+    std::uint64_t                                   id;
+
+    //shared with the ready hooks of pending prefetches, which may finish after the prefetcher is gone
+    struct signal {
+        std::mutex              mutex;
+        std::condition_variable wake;
+    };
+
+    std::shared_ptr<signal>                         sync = std::make_shared<signal>();
+    std::vector<row>                                rows;
+    std::deque<std::string>                         queue;
+    std::unordered_set<std::string>                 queued;         //names in queue
+    std::unordered_map<std::string, held_resource>  held;
+    std::list<std::string>                          held_order;     //oldest first
+    prefetch_stats                                  counters = {};
+    bool                                            stopping = false;
+    std::thread                                     worker;
+
+    static std::uint64_t hash(const char* name) {
+        return detail::fnv1a(name, std::strlen(name)) | 1;   //0 marks empty rows
+    }
+
+    //set on the worker thread, so its own "get" calls aren't learned from
+    static bool& prefetching() {
+        thread_local bool value = false;
+        return value;
+    }
+
+    //last resource requested by the calling thread, per prefetcher
+    std::uint64_t& previous() {
+        thread_local std::unordered_map<std::uint64_t, std::uint64_t> last;
+        return last[id];
+    }
+
+    //call under mutex
+    row& row_of(std::uint64_t key) {
+        return rows[key % rows.size()];
+    }
+
+    //call under mutex
+    //counts name as a successor of the predecessor; the total of a row is kept equal to the sum of its counts
+    void learn(std::uint64_t predecessor, const char* name) {
+        auto& r = row_of(predecessor);
+
+        //a busy row resists being taken over by a rarely seen predecessor, its weakest successor fading meanwhile
+        if (r.key != predecessor) {
+            if (r.total > 1) {
+                successor* weakest = nullptr;
+                for (auto& s : r.next)
+                    if (s.count && (!weakest || s.count < weakest->count)) weakest = &s;
+
+                weakest->count--;
+                r.total--;
+                return;
+            }
+            r = row();
+            r.key = predecessor;
+        }
+
+        successor* weakest = &r.next[0];
+        for (auto& s : r.next) {
+            if (s.count && s.name == name) {
+                s.count++;
+                r.total++;
+                age(r);
+                return;
+            }
+            if (s.count < weakest->count) weakest = &s;
+        }
+
+        //space saving: the weakest successor is replaced once it decays to nothing
+        if (weakest->count > 1) {
+            weakest->count--;
+            r.total--;
+        }
+        else {
+            r.total += 1 - weakest->count;
+            weakest->name  = name;
+            weakest->count = 1;
+        }
+        age(r);
+    }
+
+    //halves the counts of a row so it follows changes of the access pattern
+    static void age(row& r) {
+        if (r.total < 1024) return;
+
+        r.total = 0;
+        for (auto& s : r.next) {
+            s.count /= 2;
+            r.total += s.count;
+        }
+    }
+
+    //call under mutex
+    //queues likely successors of name
+    void predict(std::uint64_t key) {
+        auto& r = row_of(key);
+        if (r.key != key || !r.total) return;
+
+        for (auto& s : r.next) {
+            if (s.count < config.min_count || s.count < config.min_confidence * r.total) continue;
+            if (held.count(s.name) || queued.count(s.name)) continue;
+
+            if (queue.size() >= config.queue) {
+                counters.dropped++;
+                continue;
+            }
+
+            queue.push_back(s.name);
+            queued.insert(s.name);
+            counters.predictions++;
+        }
+    }
+
+    void on_access(const char* name) {
+        if (prefetching()) return;
+
+        auto key  = hash(name);
+        auto& last = previous();
+
+        //the caller's handle already holds the resource, so the prefetch lets go of it on first use
+        handle used;
+
+        std::unique_lock<std::mutex> lock(sync->mutex);
+
+        if (last) learn(last, name);
+        last = key;
+
+        auto itr = held.find(name);
+        if (itr != held.end()) {
+            counters.hits++;
+            used = std::move(itr->second.resource);
+            held_order.erase(itr->second.order);
+            held.erase(itr);
+        }
+
+        auto pending = queue.size();
+        predict(key);
+        bool predicted = queue.size() != pending;
+        lock.unlock();
+
+        used = handle();
+        if (predicted) sync->wake.notify_one();
+    }
+
+    static void access_hook(void* context, const char* name) {
+        static_cast<prefetcher*>(context)->on_access(name);
+    }
+
+    //a finished prefetch frees a slot for the next one
+    static void load_finished(void* context, bool) {
+        auto shared = static_cast<std::shared_ptr<signal>*>(context);
+        { std::lock_guard<std::mutex> lock((*shared)->mutex); }
+        (*shared)->wake.notify_all();
+        delete shared;
+    }
+
+    //call under mutex
+    unsigned int inflight() {
+        unsigned int n = 0;
+        for (auto& h : held) n += h.second.resource.loading();
+        return n;
+    }
+
+    void work() {
+        prefetching() = true;
+
+        std::unique_lock<std::mutex> lock(sync->mutex);
+        for (;;) {
+            //the loader is considered busy while earlier prefetches are still loading
+            sync->wake.wait(lock, [this] {
+                return stopping || (!queue.empty() && inflight() < config.max_inflight);
+            });
+            if (stopping) return;
+
+            auto name = std::move(queue.front());
+            queue.pop_front();
+            queued.erase(name);
+            lock.unlock();
+
+            auto resource = lotus::get(name.c_str(), reg);
+            if (resource.loading()) lotus::when_ready(resource, &load_finished, new std::shared_ptr<signal>(sync));
+
+            //handles let go outside of the mutex, as the last one unloads the resource
+            std::vector<handle> dropped;
+
+            lock.lock();
+            counters.issued++;
+            auto added = held.emplace(name, held_resource{resource, {}});
+            if (added.second) added.first->second.order = held_order.insert(held_order.end(), name);
+
+            while (held.size() > config.max_held) {
+                auto oldest = held.find(held_order.front());
+                held_order.pop_front();
+
+                counters.wasted++;
+                dropped.push_back(std::move(oldest->second.resource));
+                held.erase(oldest);
+            }
+
+            lock.unlock();
+            dropped.clear();
+            resource = handle();
+            lock.lock();
+        }
+    }
+
+public:
+    prefetcher(registry& _reg, const prefetch_config& _config = {}) : reg(_reg), config(_config) {
+        static std::atomic<std::uint64_t> next{0};
+        id = next.fetch_add(1);
+
+        rows.resize(config.rows ? config.rows : 1);
+        lotus::add_access_hook(reg, &access_hook, this);
+        worker = std::thread([this] { work(); });
+    }
+
+    prefetcher(const prefetcher&) = delete;
+    prefetcher& operator=(const prefetcher&) = delete;
+
+    // removes its access hook and lets prefetched resources go
+    // not thread safe, destroy once the registry is no longer used by other threads
+    ~prefetcher() {
+        lotus::remove_access_hook(reg, &access_hook, this);
+
+        std::unique_lock<std::mutex> lock(sync->mutex);
+        stopping = true;
+        lock.unlock();
+        sync->wake.notify_all();
+        worker.join();
+
+        counters.wasted += held.size();
+        held.clear();
+    }
+
+    // thread safe
+    prefetch_stats stats() {
+        std::lock_guard<std::mutex> lock(sync->mutex);
+        return counters;
+    }
+
+    // releases prefetched resources that weren't used yet, counting them as wasted
+    // thread safe
+    void drop_unused() {
+        std::vector<handle> dropped;
+
+        std::unique_lock<std::mutex> lock(sync->mutex);
+        counters.wasted += held.size();
+        for (auto& h : held) dropped.push_back(std::move(h.second.resource));
+        held.clear();
+        held_order.clear();
+
+        //the last handles unload the resources, outside of the mutex
+        lock.unlock();
+    }
+};
@@ -0,0 +1,305 @@
+#pragma once
+
+#include "lotus.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+//=================
+// Forwards
+
+namespace lotus {
+    // single recorded registry event
+    struct recorded_event {
+        std::uint64_t   time;       //nanoseconds since the recorder was created
+        std::uint32_t   name;       //index into recording::names; no_name for registry wide events
+        registry_event  event;
+
+        static constexpr std::uint32_t no_name = 0xffffffff;
+    };
+
+    // events of one thread, in the order they happened
+    struct recorded_thread {
+        std::uint32_t               thread;
+        std::vector<recorded_event> events;
+    };
+
+    // complete recorded workload
+    struct recording {
+        std::vector<std::string>        names;
+        std::vector<recorded_thread>    threads;
+    };
+
+    // records registry events of every thread into per-thread buffers, for replay with identical schedule
+    //
+    // file layout (little endian):
+    //   u32 magic "LTRC", u32 version
+    //   u32 name count, names: u16 name size, name
+    //   u32 thread count, threads: u32 thread, u64 event count, events
+    //   event: varint time delta to the previous event of the thread, varint (name index + 1) << 3 | event
+    struct recorder;
+
+    // starts recording events of the registry
+    // not thread safe, attach before the registry is shared between threads
+    template<class resource_type, class policy, class loader_type>
+    void record_events(resource_registry<resource_type, policy, loader_type>&, recorder&);
+
+    // reads a file written by recorder::save; returns false when the file is missing or malformed
+    bool load_recording(const char* path, recording&);
+
+    // names of recorded "get" events in order of their first use over all threads; each name appears once
+    std::vector<std::string> first_use_order(const recording&);
+}
+
+//=================
+// Recorder
+
+struct lotus::recorder {
+private:
+    static constexpr std::uint32_t magic_value   = 0x4352544c;   //"LTRC"
+    static constexpr std::uint32_t version_value = 1;
+
+    friend bool lotus::load_recording(const char*, recording&);
+
+    //names are interned per thread so recording never takes a shared lock
+    struct buffer {
+        std::mutex                                      mutex;  //taken by the owning thread and by saves only
+        std::uint32_t                                   thread;
+        std::vector<recorded_event>                     events;
+        std::vector<std::string>                        names;
+        std::unordered_map<std::string, std::uint32_t>  ids;
+    };
+
+    std::chrono::steady_clock::time_point   start = std::chrono::steady_clock::now();
+    std::uint64_t                           id;
+    std::mutex                              mutex;
+    std::vector<std::shared_ptr<buffer>>    buffers;
+
+    buffer& local() {
+        //keyed by recorder id rather than address, so a new recorder never picks up buffers of a destroyed one
+        thread_local std::unordered_map<std::uint64_t, std::shared_ptr<buffer>> local_buffers;
+
+        auto& b = local_buffers[id];
+        if (!b) {
+            b = std::make_shared<buffer>();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            b->thread = static_cast<std::uint32_t>(buffers.size());
+            buffers.push_back(b);
+        }
+        return *b;
+    }
+
+    static void write_varint(std::vector<unsigned char>& out, std::uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    static bool read_varint(std::FILE* file, std::uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int c = std::fgetc(file);
+            if (c == EOF) return false;
+
+            value |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+            if (!(c & 0x80)) return true;
+        }
+        return false;
+    }
+
+public:
+    recorder() {
+        static std::atomic<std::uint64_t> next{0};
+        id = next.fetch_add(1);
+    }
+
+    recorder(const recorder&) = delete;
+    recorder& operator=(const recorder&) = delete;
+
+    // appends an event for the calling thread; name may be nullptr
+    // thread safe
+    void record(registry_event event, const char* name) {
+        auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        auto& b = local();
+
+        std::lock_guard<std::mutex> lock(b.mutex);
+
+        auto index = recorded_event::no_name;
+        if (name) {
+            auto itr = b.ids.find(name);
+            if (itr == b.ids.end()) {
+                itr = b.ids.insert({name, static_cast<std::uint32_t>(b.names.size())}).first;
+                b.names.push_back(name);
+            }
+            index = itr->second;
+        }
+
+        b.events.push_back({static_cast<std::uint64_t>(time), index, event});
+    }
+
+    // copy of the events gathered so far, with names merged over all threads
+    // thread safe
+    recording snapshot() {
+        std::vector<std::shared_ptr<buffer>> copy;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            copy = buffers;
+        }
+
+        recording out;
+        std::unordered_map<std::string, std::uint32_t> ids;
+
+        for (auto& b : copy) {
+            std::lock_guard<std::mutex> lock(b->mutex);
+
+            std::vector<std::uint32_t> remap(b->names.size());
+            for (std::size_t i = 0; i < b->names.size(); i++) {
+                auto itr = ids.insert({b->names[i], static_cast<std::uint32_t>(out.names.size())}).first;
+                if (itr->second == out.names.size()) out.names.push_back(b->names[i]);
+                remap[i] = itr->second;
+            }
+
+            out.threads.push_back({b->thread, b->events});
+            for (auto& e : out.threads.back().events)
+                if (e.name != recorded_event::no_name) e.name = remap[e.name];
+        }
+
+        return out;
+    }
+
+    // writes gathered events to a file; returns false on io error
+    // thread safe
+    bool save(const char* path) {
+        auto r = snapshot();
+
+        auto file = std::fopen(path, "wb");
+        if (!file) return false;
+
+        std::uint32_t header[3] = {magic_value, version_value, static_cast<std::uint32_t>(r.names.size())};
+        bool ok = std::fwrite(header, sizeof(header), 1, file) == 1;
+
+        for (auto& n : r.names) {
+            if (!ok) break;
+
+            auto size = static_cast<std::uint16_t>(n.size() < 0xffff ? n.size() : 0xffff);
+            ok = std::fwrite(&size, sizeof(size), 1, file) == 1
+                && std::fwrite(n.data(), 1, size, file) == size;
+        }
+
+        auto thread_count = static_cast<std::uint32_t>(r.threads.size());
+        ok = ok && std::fwrite(&thread_count, sizeof(thread_count), 1, file) == 1;
+
+        std::vector<unsigned char> encoded;
+        for (auto& t : r.threads) {
+            if (!ok) break;
+
+            encoded.clear();
+            std::uint64_t last = 0;
+            for (auto& e : t.events) {
+                //a thread's events are recorded in order, but guard against clock oddities
+                write_varint(encoded, e.time > last ? e.time - last : 0);
+                std::uint64_t name = e.name == recorded_event::no_name ? 0 : std::uint64_t(e.name) + 1;
+                write_varint(encoded, name << 3 | static_cast<std::uint64_t>(e.event));
+                if (e.time > last) last = e.time;
+            }
+
+            std::uint64_t count = t.events.size();
+            ok = std::fwrite(&t.thread, sizeof(t.thread), 1, file) == 1
+                && std::fwrite(&count, sizeof(count), 1, file) == 1
+                && std::fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+        }
+
+        return std::fclose(file) == 0 && ok;
+    }
+};
+
+//=================
+// Functions
+
+template<class resource_type, class policy, class loader_type>
+void lotus::record_events(resource_registry<resource_type, policy, loader_type>& reg, recorder& rec) {
+    lotus::set_event_hook(reg, [](void* context, registry_event event, const char* name) {
+        static_cast<recorder*>(context)->record(event, name);
+    }, &rec);
+}
+
+inline bool lotus::load_recording(const char* path, recording& out) {
+    auto file = std::fopen(path, "rb");
+    if (!file) return false;
+
+    std::uint32_t header[3];
+    bool ok = std::fread(header, sizeof(header), 1, file) == 1
+        && header[0] == recorder::magic_value && header[1] == recorder::version_value;
+
+    for (std::uint32_t i = 0; ok && i < header[2]; i++) {
+        std::uint16_t size;
+        ok = std::fread(&size, sizeof(size), 1, file) == 1;
+        if (!ok) break;
+
+        std::string name(size, '\0');
+        ok = std::fread(&name[0], 1, size, file) == size;
+        out.names.push_back(std::move(name));
+    }
+
+    std::uint32_t thread_count = 0;
+    ok = ok && std::fread(&thread_count, sizeof(thread_count), 1, file) == 1;
+
+    for (std::uint32_t i = 0; ok && i < thread_count; i++) {
+        recorded_thread t;
+        std::uint64_t count;
+
+        ok = std::fread(&t.thread, sizeof(t.thread), 1, file) == 1
+            && std::fread(&count, sizeof(count), 1, file) == 1;
+
+        std::uint64_t time = 0;
+        for (std::uint64_t e = 0; ok && e < count; e++) {
+            std::uint64_t delta, packed;
+            ok = recorder::read_varint(file, delta) && recorder::read_varint(file, packed);
+            if (!ok) break;
+
+            auto event = packed & 7;
+            auto name  = packed >> 3;
+            ok = event <= static_cast<std::uint64_t>(registry_event::refresh) && name <= out.names.size();
+            if (!ok) break;
+
+            time += delta;
+            auto index = name == 0 ? recorded_event::no_name : static_cast<std::uint32_t>(name - 1);
+            t.events.push_back({time, index, static_cast<registry_event>(event)});
+        }
+
+        if (ok) out.threads.push_back(std::move(t));
+    }
+
+    std::fclose(file);
+    return ok;
+}
+
+inline std::vector<std::string> lotus::first_use_order(const recording& r) {
+    //each thread's events are in order, but threads interleave
+    std::vector<const recorded_event*> gets;
+    for (auto& t : r.threads)
+        for (auto& e : t.events)
+            if (e.event == registry_event::get && e.name != recorded_event::no_name) gets.push_back(&e);
+
+    std::stable_sort(gets.begin(), gets.end(), [](const recorded_event* a, const recorded_event* b) {
+        return a->time < b->time;
+    });
+
+    std::vector<std::string> order;
+    std::vector<bool> seen(r.names.size());
+    for (auto e : gets) {
+        if (seen[e->name]) continue;
+        seen[e->name] = true;
+        order.push_back(r.names[e->name]);
+    }
+    return order;
+}
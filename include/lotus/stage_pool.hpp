@@ -0,0 +1,96 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+//=================
+// Forwards
+
+namespace lotus {
+    // fixed set of threads consuming a bounded queue of jobs
+    // pushing into a full queue blocks, which throttles the producer
+    // stage threads feeding a queue their own stage waits on must post instead, or they can deadlock
+    struct stage_pool;
+}
+
+//=================
+// Stage Pool
+
+struct lotus::stage_pool {
+private:
+    std::mutex                          mutex;
+    std::condition_variable             not_empty;
+    std::condition_variable             not_full;
+    std::deque<std::function<void()>>   jobs;
+    std::vector<std::thread>            threads;
+    std::size_t                         capacity;
+    bool                                stopping = false;
+
+    void work() {
+        for (;;) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return;
+
+            auto job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            not_full.notify_one();
+
+            job();
+        }
+    }
+
+public:
+    stage_pool(unsigned int thread_count, std::size_t _capacity)
+        : capacity(_capacity ? _capacity : 1) {
+        if (thread_count == 0) thread_count = 1;
+        for (unsigned int i = 0; i < thread_count; i++) threads.emplace_back([this] { work(); });
+    }
+
+    stage_pool(const stage_pool&) = delete;
+    stage_pool& operator=(const stage_pool&) = delete;
+
+    ~stage_pool() {
+        stop();
+    }
+
+    // finishes queued jobs and joins the threads
+    void stop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+        lock.unlock();
+
+        not_empty.notify_all();
+        for (auto& t : threads) t.join();
+        threads.clear();
+    }
+
+    // blocks while the queue is full
+    void push(std::function<void()> job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return jobs.size() < capacity; });
+        jobs.push_back(std::move(job));
+        lock.unlock();
+        not_empty.notify_one();
+    }
+
+    // queues past capacity without blocking
+    void post(std::function<void()> job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+        lock.unlock();
+        not_empty.notify_one();
+    }
+
+    // whether the calling thread is one of the pool threads
+    bool on_worker() const {
+        for (auto& t : threads)
+            if (t.get_id() == std::this_thread::get_id()) return true;
+        return false;
+    }
+};
@@ -0,0 +1,473 @@
+#pragma once
+
+#include "lotus.hpp"
+#include "lz.hpp"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <utility>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+//=================
+// Forwards
+
+namespace lotus {
+    // byte budgets of the tiers below the registry
+    struct tiered_config {
+        std::uint64_t   warm_bytes   = 64 << 20;    //compressed bytes kept in memory
+        std::uint64_t   cold_bytes   = 1ull << 30;  //compressed bytes spilled to disk
+        std::string     directory;                  //existing directory for spill files, may be shared; empty disables the cold tier
+        unsigned int    promote_hits = 2;           //loads after which a cold resource moves back to memory
+    };
+
+    // counters and sizes of a tiered loader
+    struct tiered_stats {
+        std::uint64_t   warm_hits;      //loads restored from compressed memory
+        std::uint64_t   cold_hits;      //loads restored from spill files
+        std::uint64_t   source_reads;   //loads that had to read and decode the source
+        std::uint64_t   demotions;      //unloaded resources compressed into memory
+        std::uint64_t   spills;         //compressed resources moved from memory to disk
+        std::uint64_t   promotions;     //spilled resources moved back to memory
+        std::uint64_t   drops;          //spilled resources deleted to fit the cold budget
+        std::uint64_t   warm_bytes;     //compressed bytes in memory now
+        std::uint64_t   cold_bytes;     //compressed bytes on disk now
+    };
+
+    // loader keeping resources in three tiers: hot ones decoded in the registry, warm ones as lz compressed bytes
+    // in memory and cold ones in spill files, so a resource evicted from the registry comes back without decoding
+    // its source again
+    //
+    // the hot tier is bounded by the registry's resident budget (lotus::set_resident_budget, bytes from codec.size);
+    // unloaded resources are compressed into the warm tier, whose clock hand spills resources loaded fewer times to
+    // disk and gives frequently loaded ones a second chance; over the cold budget spill files are deleted the same
+    // way; a cold resource loaded promote_hits times moves back to memory
+    // compression and spill file writes run on the thread unloading the resource, after the registry unlocked
+    //
+    // codec_type provides, called from any thread:
+    //   resource_type* read(const char* name)                      loads the source; nullptr fails the load
+    //   std::uint64_t size(const resource_type&)                   decoded bytes
+    //   void store(const resource_type&, std::vector<unsigned char>&)  serializes the object
+    //   resource_type* restore(const unsigned char*, std::size_t)  deserializes it; nullptr falls back to read
+    //   void destroy(resource_type*)
+    //
+    // tier copies are reused as long as they exist; call invalidate before reloading a resource whose source changed
+    template<class resource_type, class codec_type>
+    struct tiered_loader;
+}
+
+//=================
+// Tiered Loader
+
+template<class resource_type, class codec_type>
+struct lotus::tiered_loader {
+private:
+    using bytes = std::shared_ptr<const std::vector<unsigned char>>;
+
+    static constexpr std::uint32_t file_magic = 0x5a4c544c;    //"LTLZ"
+
+    struct spill_header {
+        std::uint32_t   magic;
+        std::uint32_t   name_size;
+        std::uint64_t   raw;
+    };
+
+    struct entry {
+        bytes           warm;           //compressed copy in memory, if any
+        std::uint64_t   raw      = 0;   //size of the stored object before compression
+        std::uint64_t   file     = 0;   //spill file id; 0 when not on disk
+        std::uint64_t   on_disk  = 0;
+        std::uint64_t   seq      = 0;   //bumped whenever the entry enters the warm tier
+        unsigned int    freq     = 1;   //loads served from the tiers, aged by the clock hands
+    };
+
+    struct slot {
+        std::string     name;
+        std::uint64_t   tag;            //seq for the warm ring, file id for the cold one
+    };
+
+    struct spill {
+        std::string     name;
+        std::uint64_t   file;
+        std::uint64_t   raw;
+        bytes           data;
+    };
+
+    //file work collected under the mutex and done after unlocking it
+    struct io {
+        std::vector<spill>          writes;
+        std::vector<std::uint64_t>  removes;
+    };
+
+    codec_type                                          codec;
+    tiered_config                                       config;
+    std::string                                         prefix;     //spill file path up to the id, unique per loader
+
+    std::mutex                                          mutex;
+    std::unordered_map<std::string, entry>              entries;
+    std::unordered_map<const resource_type*, std::string> hot;    //names of objects handed to the registry
+    std::unordered_multimap<std::string, const resource_type*> hot_names;  //the same, by name
+    std::deque<slot>                                    warm_ring;
+    std::deque<slot>                                    cold_ring;
+    std::uint64_t                                       next_file = 0;
+    tiered_stats                                        counters = {};
+
+    std::string path_of(std::uint64_t file) const {
+        return prefix + std::to_string(file) + ".lz";
+    }
+
+    //call under mutex
+    void insert_warm(const std::string& name, entry& e, bytes data, io& work) {
+        if (e.file) drop_file(e, work);
+
+        e.warm = std::move(data);
+        e.seq++;
+        counters.warm_bytes += e.warm->size();
+        warm_ring.push_back({name, e.seq});
+    }
+
+    //call under mutex
+    void drop_file(entry& e, io& work) {
+        work.removes.push_back(e.file);
+        counters.cold_bytes -= e.on_disk;
+        e.file = e.on_disk = 0;
+    }
+
+    //call under mutex
+    //drops a copy that failed to restore, unless it was replaced meanwhile; the next unload stores a new one
+    void drop_broken(const char* name, const bytes& warm, std::uint64_t file, io& work) {
+        auto itr = entries.find(name);
+        if (itr == entries.end()) return;
+
+        auto& e = itr->second;
+        if (warm && e.warm == warm) {
+            counters.warm_bytes -= e.warm->size();
+            e.warm.reset();
+        }
+        if (file && e.file == file) drop_file(e, work);
+
+        if (!e.warm && !e.file) entries.erase(itr);
+    }
+
+    //call under mutex
+    void erase_hot(const resource_type* object, const std::string& name) {
+        auto range = hot_names.equal_range(name);
+        for (auto itr = range.first; itr != range.second; ++itr) {
+            if (itr->second == object) {
+                hot_names.erase(itr);
+                break;
+            }
+        }
+    }
+
+    //call under mutex
+    //turns the clock hand of a ring until it finds a victim; entries loaded more than once are passed over,
+    //losing one count each time; returns end() when no live entry is left
+    template<class live_function>
+    typename std::unordered_map<std::string, entry>::iterator clock(std::deque<slot>& ring, live_function&& live) {
+        while (!ring.empty()) {
+            auto s = std::move(ring.front());
+            ring.pop_front();
+
+            auto itr = entries.find(s.name);
+            if (itr == entries.end() || !live(itr->second, s.tag)) continue;
+
+            if (itr->second.freq > 1) {
+                itr->second.freq--;
+                ring.push_back(std::move(s));
+                continue;
+            }
+            return itr;
+        }
+        return entries.end();
+    }
+
+    //call under mutex
+    //spills and drops entries until both tiers fit their budgets
+    void shrink(io& work) {
+        while (counters.warm_bytes > config.warm_bytes) {
+            auto itr = clock(warm_ring, [](const entry& e, std::uint64_t tag) { return e.warm && e.seq == tag; });
+            if (itr == entries.end()) break;
+
+            auto& e = itr->second;
+            auto data = std::move(e.warm);
+            e.warm.reset();
+            counters.warm_bytes -= data->size();
+
+            if (config.directory.empty() || data->size() > config.cold_bytes) {
+                entries.erase(itr);
+                continue;
+            }
+
+            e.file    = ++next_file;
+            e.on_disk = data->size();
+            counters.cold_bytes += e.on_disk;
+            counters.spills++;
+            cold_ring.push_back({itr->first, e.file});
+            work.writes.push_back({itr->first, e.file, e.raw, std::move(data)});
+        }
+
+        while (counters.cold_bytes > config.cold_bytes) {
+            auto itr = clock(cold_ring, [](const entry& e, std::uint64_t tag) { return e.file == tag; });
+            if (itr == entries.end()) break;
+
+            drop_file(itr->second, work);
+            counters.drops++;
+            if (!itr->second.warm) entries.erase(itr);
+        }
+    }
+
+    //writes spill files and deletes dropped ones; takes the mutex to delete files dropped while being written
+    void run(io& work) {
+        for (auto& w : work.writes) {
+            auto path = path_of(w.file);
+            auto temp = path + ".tmp";
+
+            //readers only ever see whole files
+            bool written = false;
+            if (auto file = std::fopen(temp.c_str(), "wb")) {
+                spill_header header = {file_magic, static_cast<std::uint32_t>(w.name.size()), w.raw};
+                written = std::fwrite(&header, sizeof(header), 1, file) == 1
+                       && std::fwrite(w.name.data(), 1, w.name.size(), file) == w.name.size()
+                       && std::fwrite(w.data->data(), 1, w.data->size(), file) == w.data->size();
+                written = std::fclose(file) == 0 && written;
+            }
+            written = written && std::rename(temp.c_str(), path.c_str()) == 0;
+            if (!written) std::remove(temp.c_str());
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto itr = entries.find(w.name);
+            bool current = itr != entries.end() && itr->second.file == w.file;
+
+            if (written && current) continue;
+            if (current) {
+                io none;
+                drop_file(itr->second, none);
+                if (!itr->second.warm) entries.erase(itr);
+            }
+            if (written) std::remove(path.c_str());
+        }
+
+        for (auto file : work.removes) std::remove(path_of(file).c_str());
+    }
+
+    //reads a spill file written for name with raw bytes before compression; returns false when it is missing,
+    //short or isn't one
+    static bool read_file(const std::string& path, const std::string& name, std::uint64_t raw, std::vector<unsigned char>& out) {
+        auto file = std::fopen(path.c_str(), "rb");
+        if (!file) return false;
+
+        spill_header header;
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1;
+        ok = ok && header.magic == file_magic && header.name_size == name.size() && header.raw == raw;
+
+        std::string stored;
+        if (ok) {
+            stored.resize(header.name_size);
+            ok = std::fread(&stored[0], 1, stored.size(), file) == stored.size() && stored == name;
+        }
+
+        unsigned char buffer[1 << 16];
+        std::size_t n;
+        out.clear();
+        while (ok && (n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) out.insert(out.end(), buffer, buffer + n);
+        ok = ok && !std::ferror(file);
+
+        std::fclose(file);
+        return ok;
+    }
+
+    resource_type* restore(const std::vector<unsigned char>& compressed, std::uint64_t raw) {
+        std::vector<unsigned char> decoded(raw);
+        if (!lotus::lz_decompress(compressed.data(), compressed.size(), decoded.data(), decoded.size())) return nullptr;
+        return codec.restore(decoded.data(), decoded.size());
+    }
+
+public:
+    template<class... codec_args>
+    tiered_loader(const tiered_config& _config, codec_args&&... args)
+        : codec(std::forward<codec_args>(args)...), config(_config) {
+        //loaders of this and other processes may share the directory; each one only touches its own files
+        static std::atomic<std::uint64_t> instances{0};
+#if defined(_WIN32)
+        auto pid = ::_getpid();
+#else
+        auto pid = ::getpid();
+#endif
+        prefix = config.directory + "/lotus_" + std::to_string(pid) + "_" + std::to_string(instances.fetch_add(1)) + "_";
+    }
+
+    tiered_loader(const tiered_loader&) = delete;
+    tiered_loader& operator=(const tiered_loader&) = delete;
+
+    // deletes the spill files
+    ~tiered_loader() {
+        for (auto& e : entries)
+            if (e.second.file) std::remove(path_of(e.second.file).c_str());
+    }
+
+    template<class registry_type, class token_type>
+    void load(const char* name, registry_type&, token_type token) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        bytes warm;
+        std::uint64_t raw = 0, file = 0;
+        auto itr = entries.find(name);
+        if (itr != entries.end()) {
+            auto& e = itr->second;
+            if (e.freq < ~0u) e.freq++;
+            raw = e.raw;
+            if (e.warm) warm = e.warm;
+            else        file = e.file;
+        }
+        lock.unlock();
+
+        resource_type* object = nullptr;
+
+        if (warm) {
+            object = restore(*warm, raw);
+
+            io work;
+            lock.lock();
+            if (object) counters.warm_hits++;
+            else        drop_broken(name, warm, 0, work);
+            lock.unlock();
+            run(work);
+        }
+        else if (file) {
+            std::vector<unsigned char> compressed;
+            if (read_file(path_of(file), name, raw, compressed)) object = restore(compressed, raw);
+
+            io work;
+            lock.lock();
+            if (object) {
+                counters.cold_hits++;
+
+                //frequently loaded resources move back to memory, already compressed
+                auto e = entries.find(name);
+                if (e != entries.end() && e->second.file == file && e->second.freq >= config.promote_hits) {
+                    insert_warm(e->first, e->second, std::make_shared<const std::vector<unsigned char>>(std::move(compressed)), work);
+                    counters.promotions++;
+                    shrink(work);
+                }
+            }
+            else drop_broken(name, nullptr, file, work);
+            lock.unlock();
+            run(work);
+        }
+
+        if (!object) {
+            object = codec.read(name);
+            if (!object) return lotus::fail(token, "source read failed");
+
+            lock.lock();
+            counters.source_reads++;
+            lock.unlock();
+        }
+
+        auto size = codec.size(*object);
+
+        lock.lock();
+        hot[object] = name;
+        hot_names.insert({name, object});
+        lock.unlock();
+
+        lotus::complete(token, object, size);
+    }
+
+    // compresses the object into memory unless a copy is kept already, then destroys it
+    void unload(resource_type* object) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        auto h = hot.find(object);
+        if (h == hot.end()) {
+            lock.unlock();
+            return codec.destroy(object);
+        }
+
+        auto name = std::move(h->second);
+        hot.erase(h);
+        erase_hot(object, name);
+
+        //cold copies of rarely loaded resources are kept as they are
+        auto itr = entries.find(name);
+        if (itr != entries.end() && (itr->second.warm || (itr->second.file && itr->second.freq < config.promote_hits))) {
+            lock.unlock();
+            return codec.destroy(object);
+        }
+        lock.unlock();
+
+        std::vector<unsigned char> raw, compressed;
+        codec.store(*object, raw);
+        codec.destroy(object);
+        lotus::lz_compress(raw.data(), raw.size(), compressed);
+
+        io work;
+        lock.lock();
+
+        //loaded and unloaded again meanwhile
+        auto& e = entries[name];
+        if (!e.warm) {
+            e.raw = raw.size();
+            insert_warm(name, e, std::make_shared<const std::vector<unsigned char>>(std::move(compressed)), work);
+            counters.demotions++;
+            shrink(work);
+        }
+
+        lock.unlock();
+        run(work);
+    }
+
+    // drops the warm and cold copies of a resource, so the next load reads its source; the loaded object, if any,
+    // is destroyed on unload without being compressed
+    // thread safe
+    void invalidate(const char* name) {
+        io work;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        auto range = hot_names.equal_range(name);
+        for (auto itr = range.first; itr != range.second; ++itr) hot.erase(itr->second);
+        hot_names.erase(range.first, range.second);
+
+        auto itr = entries.find(name);
+        if (itr != entries.end()) {
+            if (itr->second.warm) counters.warm_bytes -= itr->second.warm->size();
+            if (itr->second.file) drop_file(itr->second, work);
+            entries.erase(itr);
+        }
+
+        lock.unlock();
+        run(work);
+    }
+
+    // thread safe
+    tiered_stats stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+    // changes the budgets of the warm and cold tiers, spilling and dropping right away when they shrink
+    // thread safe
+    void set_budgets(std::uint64_t warm_bytes, std::uint64_t cold_bytes) {
+        io work;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        config.warm_bytes = warm_bytes;
+        config.cold_bytes = cold_bytes;
+        shrink(work);
+
+        lock.unlock();
+        run(work);
+    }
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+// hierarchical timer wheel scheduling resource expiry
+// included by lotus.hpp
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+//=================
+// Forwards
+
+namespace lotus {
+    // timers in four levels of slots: 256 slots of one tick, then three levels of 64 slots, each slot spanning a
+    // whole turn of the level below; schedule is O(1), and a timer is moved down at most three times before it fires
+    // advancing skips the ticks in which only empty levels would be processed, so a long idle gap costs about one
+    // step per slot passed on the lowest level holding timers rather than one per tick
+    // deadlines are in ticks; ones beyond the last level (2^26 ticks ahead) fire at the end of its range
+    // timers can't be cancelled; owners tag items and ignore stale ones when they fire
+    //
+    // not thread safe
+    template<class item_type>
+    struct timer_wheel;
+}
+
+//=================
+// Timer Wheel
+
+template<class item_type>
+struct lotus::timer_wheel {
+private:
+    static constexpr unsigned int   first_bits  = 8;
+    static constexpr unsigned int   level_bits  = 6;
+    static constexpr unsigned int   levels      = 4;
+    static constexpr std::uint64_t  first_slots = 1ull << first_bits;
+    static constexpr std::uint64_t  level_slots = 1ull << level_bits;
+    static constexpr std::uint64_t  range       = 1ull << (first_bits + level_bits * (levels - 1));
+
+    struct timer {
+        std::uint64_t   deadline;
+        item_type       item;
+    };
+
+    std::vector<timer>  slots[levels][first_slots];     //levels above the first use level_slots of them
+    std::size_t         counts[levels] = {};            //timers per level
+    std::uint64_t       now   = 0;                      //last tick processed
+    std::size_t         count = 0;
+
+    static unsigned int shift(unsigned int level) {
+        return level ? first_bits + level_bits * (level - 1) : 0;
+    }
+
+    //timers moved down by a cascade may be due on the current tick, whose slot is processed right after
+    void insert(timer&& t) {
+        if (t.deadline - now >= range) t.deadline = now + range - 1;
+
+        auto delta = t.deadline - now;
+        unsigned int level = 0;
+        while (level + 1 < levels && delta >= (1ull << shift(level + 1))) level++;
+
+        auto mask = level ? level_slots - 1 : first_slots - 1;
+        slots[level][(t.deadline >> shift(level)) & mask].push_back(std::move(t));
+        counts[level]++;
+    }
+
+    //moves the timers of the current slot of a level into lower levels; returns the slot index
+    std::uint64_t cascade(unsigned int level) {
+        auto index = (now >> shift(level)) & (level_slots - 1);
+
+        std::vector<timer> moved;
+        moved.swap(slots[level][index]);
+        counts[level] -= moved.size();
+        for (auto& t : moved) insert(std::move(t));
+
+        return index;
+    }
+
+public:
+    // schedules an item for given tick
+    void schedule(std::uint64_t deadline, item_type item) {
+        //timers due already fire on the next tick
+        insert({deadline > now ? deadline : now + 1, std::move(item)});
+        count++;
+    }
+
+    // processes ticks up to and including given one, passing items of due timers to on_expired
+    // costs one step per tick while the first level holds timers, otherwise one per slot of the lowest level
+    // holding them, plus the timers moved and fired
+    template<class function>
+    void advance(std::uint64_t tick, function&& on_expired) {
+        while (now < tick) {
+            //nothing to move or fire; catch up in one step
+            if (!count) {
+                now = tick;
+                return;
+            }
+
+            //the levels below the lowest one holding timers are empty until its next slot cascades
+            unsigned int lowest = 0;
+            while (!counts[lowest]) lowest++;
+
+            if (lowest) {
+                auto turn = 1ull << shift(lowest);
+                auto before_cascade = (now / turn + 1) * turn - 1;
+                if (before_cascade > now) {
+                    now = before_cascade < tick ? before_cascade : tick;
+                    continue;
+                }
+            }
+
+            now++;
+
+            auto index = now & (first_slots - 1);
+            for (unsigned int level = 1; !index && level < levels; level++)
+                index = cascade(level);
+
+            std::vector<timer> due;
+            due.swap(slots[0][now & (first_slots - 1)]);
+            counts[0] -= due.size();
+            count -= due.size();
+            for (auto& t : due) on_expired(t.item);
+        }
+    }
+
+    // last processed tick
+    std::uint64_t tick() const {
+        return now;
+    }
+
+    // number of scheduled timers
+    std::size_t size() const {
+        return count;
+    }
+};
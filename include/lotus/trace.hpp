@@ -0,0 +1,191 @@
+#pragma once
+
+// span tracing of registry activity, exported as Chrome trace-event json (opens in Perfetto / chrome://tracing)
+// included by lotus.hpp when LOTUS_TRACE is defined; without it the LOTUS_TRACE_* macros expand to nothing
+
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+//=================
+// Forwards
+
+namespace lotus {
+    // single recorded event
+    struct trace_event {
+        char            phase;      //'X' span, 'b' async begin, 'e' async end
+        const char*     name;       //string literal
+        std::uint64_t   time;       //nanoseconds
+        std::uint64_t   duration;   //nanoseconds, spans only
+        std::uint64_t   id;         //async events only
+        char            resource[48];
+    };
+
+    // per-thread ring buffers of trace events
+    // when a buffer is full the oldest events are overwritten
+    struct tracer;
+
+    // records a span from construction to destruction
+    struct trace_span;
+
+    // writes events of all threads to a Chrome trace-event json file; returns false on io error
+    // thread safe
+    bool write_trace(const char* path);
+}
+
+//=================
+// Tracer
+
+struct lotus::tracer {
+private:
+    struct buffer {
+        std::mutex                  mutex;      //taken by the owning thread and by flushes only
+        std::uint32_t               thread;
+        std::uint64_t               written = 0;
+        std::vector<trace_event>    events;
+    };
+
+    std::mutex                              mutex;
+    std::vector<std::shared_ptr<buffer>>    buffers;
+    std::chrono::steady_clock::time_point   start = std::chrono::steady_clock::now();
+
+    friend bool lotus::write_trace(const char*);
+
+    //buffers outlive their threads, so events of finished threads are still flushed
+    buffer& local() {
+        thread_local std::shared_ptr<buffer> local_buffer;
+        if (!local_buffer) {
+            local_buffer = std::make_shared<buffer>();
+            local_buffer->events.resize(capacity);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            local_buffer->thread = static_cast<std::uint32_t>(buffers.size() + 1);
+            buffers.push_back(local_buffer);
+        }
+        return *local_buffer;
+    }
+
+public:
+    // events kept per thread
+    static constexpr std::size_t capacity = 1 << 14;
+
+    static tracer& instance() {
+        static tracer t;
+        return t;
+    }
+
+    std::uint64_t now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void emit(char phase, const char* name, std::uint64_t time, std::uint64_t duration, std::uint64_t id, const char* resource) {
+        auto& b = local();
+
+        std::lock_guard<std::mutex> lock(b.mutex);
+        auto& e = b.events[b.written++ % capacity];
+
+        e.phase    = phase;
+        e.name     = name;
+        e.time     = time;
+        e.duration = duration;
+        e.id       = id;
+
+        std::size_t size = resource ? std::strlen(resource) : 0;
+        if (size >= sizeof(e.resource)) size = sizeof(e.resource) - 1;
+        std::memcpy(e.resource, resource ? resource : "", size);
+        e.resource[size] = '\0';
+    }
+};
+
+//=================
+// Trace Span
+
+struct lotus::trace_span {
+private:
+    const char*     name;
+    const char*     resource;
+    std::uint64_t   begin;
+
+public:
+    trace_span(const char* _name, const char* _resource)
+        : name(_name), resource(_resource), begin(tracer::instance().now()) {}
+
+    trace_span(const trace_span&) = delete;
+    trace_span& operator=(const trace_span&) = delete;
+
+    ~trace_span() {
+        auto& t = tracer::instance();
+        t.emit('X', name, begin, t.now() - begin, 0, resource);
+    }
+};
+
+//=================
+// Functions
+
+inline bool lotus::write_trace(const char* path) {
+    auto& t = tracer::instance();
+
+    std::vector<std::shared_ptr<tracer::buffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        buffers = t.buffers;
+    }
+
+    auto file = std::fopen(path, "wb");
+    if (!file) return false;
+
+    std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+    bool first = true;
+
+    for (auto& b : buffers) {
+        std::lock_guard<std::mutex> lock(b->mutex);
+
+        auto count = b->written < tracer::capacity ? b->written : tracer::capacity;
+        for (std::uint64_t i = b->written - count; i < b->written; i++) {
+            auto& e = b->events[i % tracer::capacity];
+
+            //resource names are json escaped; control characters are dropped
+            char escaped[2 * sizeof(e.resource)];
+            std::size_t n = 0;
+            for (const char* c = e.resource; *c; c++) {
+                if (static_cast<unsigned char>(*c) < 0x20) continue;
+                if (*c == '"' || *c == '\\') escaped[n++] = '\\';
+                escaped[n++] = *c;
+            }
+            escaped[n] = '\0';
+
+            std::fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"lotus\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                first ? "" : ",\n", e.name, e.phase, e.time / 1000.0, b->thread);
+            if (e.phase == 'X') std::fprintf(file, ",\"dur\":%.3f", e.duration / 1000.0);
+            else                std::fprintf(file, ",\"id\":\"0x%llx\"", static_cast<unsigned long long>(e.id));
+            std::fprintf(file, ",\"args\":{\"resource\":\"%s\"}}", escaped);
+
+            first = false;
+        }
+    }
+
+    std::fputs("\n]}\n", file);
+    return std::fclose(file) == 0;
+}
+
+//=================
+// Macros
+
+#define LOTUS_TRACE_CONCAT_(a, b) a##b
+#define LOTUS_TRACE_CONCAT(a, b) LOTUS_TRACE_CONCAT_(a, b)
+
+// records a span covering the rest of the enclosing scope
+#define LOTUS_TRACE_SPAN(name, resource) \
+    lotus::trace_span LOTUS_TRACE_CONCAT(lotus_trace_span_, __LINE__)(name, resource)
+
+// begins/ends an asynchronous span (e.g. a load finished on another thread)
+#define LOTUS_TRACE_ASYNC_BEGIN(name, id, resource) \
+    lotus::tracer::instance().emit('b', name, lotus::tracer::instance().now(), 0, id, resource)
+
+#define LOTUS_TRACE_ASYNC_END(name, id) \
+    lotus::tracer::instance().emit('e', name, lotus::tracer::instance().now(), 0, id, nullptr)
@@ -0,0 +1,92 @@
+// budget_test - resident budget and idle list under concurrent get and release
+//
+// build: c++ -std=c++17 -g -fsanitize=address,undefined -Iinclude tests/budget_test.cpp -o budget_test -pthread
+
+#undef NDEBUG
+#include <lotus/lotus.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+
+struct resource {
+    int value;
+};
+
+static std::atomic<int> alive{0};
+
+static void load(const char* name, lotus::resource_registry<resource>&, lotus::load_token<resource> token) {
+    alive++;
+    lotus::complete(token, new resource{static_cast<int>(std::string(name).size())}, 100);
+}
+
+static void unload(resource* object) {
+    alive--;
+    delete object;
+}
+
+//=================
+// Cases
+
+//releases racing on one name may both find the count at zero; the entry must be linked into the idle list once
+static void release_race() {
+    lotus::resource_registry<resource> reg(load, unload);
+    lotus::set_resident_budget(reg, 1000);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; t++)
+        threads.emplace_back([&] {
+            for (int i = 0; i < 20000; i++) {
+                auto h = lotus::get("shared", reg);
+                while (h.loading()) std::this_thread::yield();
+                assert(h.good() && h->value == 6);
+            }
+        });
+    for (auto& t : threads) t.join();
+
+    //a doubly linked entry would make eviction loop over it forever
+    lotus::set_resident_budget(reg, 1);
+    assert(alive == 0);
+
+    auto s = lotus::stats(reg);
+    assert(s.counters[lotus::registry_stats::loads] == s.counters[lotus::registry_stats::unloads]);
+}
+
+//many names cycling through a budget that holds a few of them
+static void budget_churn() {
+    lotus::resource_registry<resource> reg(load, unload);
+    lotus::set_resident_budget(reg, 500);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 20000; i++) {
+                auto name = "r" + std::to_string((i * 7 + t) % 32);
+                auto h = lotus::get(name.c_str(), reg);
+                while (h.loading()) std::this_thread::yield();
+                assert(h.good());
+                if (i % 5000 == 0) lotus::set_resident_budget(reg, 100 + 100 * t);
+            }
+        });
+    for (auto& t : threads) t.join();
+
+    //idle entries stay within the budget and are all unloaded once it is removed
+    lotus::set_resident_budget(reg, 300);
+    assert(alive <= 3);
+    lotus::set_resident_budget(reg, 0);
+    assert(alive == 0);
+
+    lotus::unload_registry(reg);
+    assert(alive == 0);
+}
+
+int main() {
+    release_race();
+    budget_churn();
+
+    std::printf("budget_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,136 @@
+// cancel_test - cancellation racing completion, and releases racing gets
+//
+// build: c++ -std=c++17 -g -fsanitize=address,undefined -Iinclude tests/cancel_test.cpp -o cancel_test -pthread
+
+#undef NDEBUG
+#include <lotus/lotus.hpp>
+#include <lotus/stage_pool.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+
+struct resource {
+    int value;
+};
+
+using registry = lotus::resource_registry<resource>;
+using S        = lotus::registry_stats;
+
+static std::atomic<int>     alive{0};       //objects created by loaders and not unloaded yet
+static std::atomic<int>     started{0};     //queued loads that ran instead of being skipped as cancelled
+static lotus::stage_pool*   pool = nullptr;
+
+static void unload(resource* object) {
+    alive--;
+    delete object;
+}
+
+static void load_sync(const char*, registry&, lotus::load_token<resource> token) {
+    alive++;
+    lotus::complete(token, new resource{1});
+}
+
+//queued jobs skip loads whose handles all expired while waiting
+static void load_async(const char*, registry&, lotus::load_token<resource> token) {
+    pool->push([token] {
+        if (token.cancelled()) return lotus::abandon(token);
+
+        started++;
+        alive++;
+        lotus::complete(token, new resource{2});
+    });
+}
+
+//=================
+// Cases
+
+//every handle expires before the loader thread gets to the job; nothing is published nor unloaded
+static void cancel_queued() {
+    lotus::stage_pool p(1, 1024);
+    pool = &p;
+    registry reg(load_async, unload);
+
+    //keeps the only loader thread busy until all requests are dropped
+    std::atomic<bool> go{false};
+    p.push([&] { while (!go) std::this_thread::yield(); });
+
+    for (int i = 0; i < 100; i++) {
+        auto h = lotus::get(("queued" + std::to_string(i)).c_str(), reg);
+        assert(h.loading() && !h.good());
+    }
+    go = true;
+    p.stop();
+
+    auto s = lotus::stats(reg);
+    assert(started == 0 && alive == 0);
+    assert(s.counters[S::cancellations] == 100 && s.counters[S::loads] == 0);
+    pool = nullptr;
+}
+
+//handles drop while loads complete on other threads; each object is either published and later unloaded,
+//or rejected by "complete" and unloaded right away
+static void cancel_complete_race() {
+    started = 0;
+
+    lotus::stage_pool p(4, 1024);
+    pool = &p;
+    {
+        registry reg(load_async, unload);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < 5000; i++) {
+                    auto h = lotus::get(("r" + std::to_string((i + t) % 16)).c_str(), reg);
+                    if (i % 3 == 0) while (h.loading()) std::this_thread::yield();
+                    if (h.good()) assert(h->value == 2);
+                }
+            });
+        for (auto& t : threads) t.join();
+        p.stop();
+
+        auto s = lotus::stats(reg);
+        assert(alive == 0);
+        assert(s.counters[S::unloads] == static_cast<std::uint64_t>(started.load()));
+        assert(s.counters[S::loads] <= s.counters[S::unloads]);
+    }
+    pool = nullptr;
+}
+
+//the last handle expiring races a get picking the resource up again; the object is unloaded exactly once
+static void release_get_race() {
+    registry reg(load_sync, unload);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([&] {
+            for (int i = 0; i < 20000; i++) {
+                //another thread may be running the loader for it
+                auto h = lotus::get("shared", reg);
+                while (h.loading()) std::this_thread::yield();
+                assert(h.good() && h->value == 1);
+
+                auto copy = h;
+                h = {};
+                assert(copy.good());
+            }
+        });
+    for (auto& t : threads) t.join();
+
+    auto s = lotus::stats(reg);
+    assert(alive == 0);
+    assert(s.counters[S::loads] == s.counters[S::unloads]);
+}
+
+int main() {
+    cancel_queued();
+    cancel_complete_race();
+    release_get_race();
+
+    std::printf("cancel_test: ok\n");
+    return 0;
+}
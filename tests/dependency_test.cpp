@@ -0,0 +1,199 @@
+// dependency_test - dependents published after their dependencies, reload cascades, and cascades through a pipeline
+//
+// build: c++ -std=c++17 -g -fsanitize=address,undefined -Iinclude tests/dependency_test.cpp -o dependency_test -pthread
+
+#undef NDEBUG
+#include <lotus/lotus.hpp>
+#include <lotus/pipeline.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+struct texture {
+    int version;
+};
+
+struct material {
+    int albedo;
+    int normal;
+};
+
+using textures  = lotus::resource_registry<texture>;
+using materials = lotus::resource_registry<material>;
+
+static textures*                                texture_reg = nullptr;
+static std::vector<lotus::load_token<texture>>  pending;        //texture loads finished by the test
+static int                                      material_loads = 0;
+
+static void load_texture(const char*, textures&, lotus::load_token<texture> token) {
+    pending.push_back(token);
+}
+
+static void unload_texture(texture* object) {
+    delete object;
+}
+
+static void load_material(const char*, materials&, lotus::load_token<material> token) {
+    material_loads++;
+
+    lotus::dependency_set<material> deps(token);
+    auto albedo = deps.add(lotus::get("albedo", *texture_reg));
+    auto normal = deps.add(lotus::get("normal", *texture_reg));
+
+    deps.then([=](bool ok) {
+        if (!ok) return lotus::abandon(token);
+        lotus::complete(token, new material{albedo->version, normal->version});
+    });
+}
+
+static void unload_material(material* object) {
+    delete object;
+}
+
+//completes the oldest pending texture load
+static void finish_texture(int version) {
+    auto token = pending.front();
+    pending.erase(pending.begin());
+    assert(lotus::complete(token, new texture{version}));
+}
+
+//=================
+// Cases
+
+//the dependent stays loading until its last dependency is published
+static void published_after_dependencies() {
+    textures  tex(load_texture, unload_texture);
+    materials mat(load_material, unload_material);
+    texture_reg = &tex;
+
+    auto h = lotus::get("grass", mat);
+    assert(h.loading() && pending.size() == 2 && material_loads == 1);
+
+    finish_texture(1);
+    assert(h.loading() && !h.good());
+
+    finish_texture(2);
+    assert(h.good() && h->albedo == 1 && h->normal == 2);
+
+    //with every dependency loaded already, the continuation runs right away
+    auto g = lotus::get("stone", mat);
+    assert(g.good() && material_loads == 2 && pending.empty());
+
+    texture_reg = nullptr;
+    material_loads = 0;
+}
+
+//reloading a dependency reloads what depends on it once the new version is published
+static void reload_cascades() {
+    textures  tex(load_texture, unload_texture);
+    materials mat(load_material, unload_material);
+    texture_reg = &tex;
+
+    auto h = lotus::get("grass", mat);
+    finish_texture(1);
+    finish_texture(2);
+    assert(h.good() && material_loads == 1);
+
+    assert(lotus::reload("albedo", tex));
+    assert(pending.size() == 1 && material_loads == 1);
+
+    finish_texture(3);
+    assert(material_loads == 2);
+    assert(h.good() && h->albedo == 3 && h->normal == 2);
+
+    //a dependency nobody reloaded leaves the dependent alone
+    assert(lotus::reload("grass", mat) && material_loads == 3 && pending.empty());
+    assert(h.good() && h->albedo == 3);
+
+    texture_reg = nullptr;
+    material_loads = 0;
+}
+
+//=================
+// Pipeline
+
+struct part {
+    int version;
+};
+
+using parts = lotus::resource_registry<part>;
+
+static lotus::loader_pipeline<part>*    part_pipeline = nullptr;
+static std::atomic<int>                 part_versions{0};
+
+static bool read_part(const char* name, std::vector<unsigned char>& bytes) {
+    bytes.assign(name, name + std::strlen(name));
+    return true;
+}
+
+static part* decode_part(const char*, std::vector<unsigned char>&) {
+    return new part{++part_versions};
+}
+
+//"whole" parts depend on a few "piece" parts; their continuation requests the read on the publishing thread
+static void load_part(const char* name, parts& reg, lotus::load_token<part> token) {
+    if (std::strncmp(name, "whole", 5) != 0) return part_pipeline->request(name, token);
+
+    int index = std::atoi(name + 5);
+    std::string owned = name;
+
+    lotus::dependency_set<part> deps(token);
+    for (int k = 0; k < 3; k++)
+        deps.add(lotus::get(("piece" + std::to_string((index + k) % 8)).c_str(), reg));
+
+    deps.then([owned, token](bool ok) {
+        if (!ok) return lotus::abandon(token);
+        part_pipeline->request(owned.c_str(), token);
+    });
+}
+
+static void unload_part(part* object) {
+    delete object;
+}
+
+static std::uint64_t part_loads(parts& reg) {
+    return lotus::stats(reg).counters[lotus::registry_stats::loads];
+}
+
+static void wait_loads(parts& reg, std::uint64_t loads) {
+    while (part_loads(reg) < loads) std::this_thread::yield();
+}
+
+//cascades run on the decode thread, which must not block on the io queue its io thread can't drain
+static void pipeline_cascade() {
+    parts reg(load_part, unload_part);
+    {
+        lotus::loader_pipeline<part> p(read_part, decode_part, nullptr, {1, 1, 1, 1});
+        part_pipeline = &p;
+
+        std::vector<lotus::resource_handle<part>> wholes;
+        for (int i = 0; i < 64; i++) wholes.push_back(lotus::get(("whole" + std::to_string(i)).c_str(), reg));
+
+        wait_loads(reg, 64 + 8);
+        for (auto& h : wholes) assert(h.good());
+
+        //wholes 6, 7 and 0 (mod 8) use piece0
+        std::uint64_t users = 0;
+        for (int i = 0; i < 64; i++) users += (i % 8 == 0 || i % 8 == 7 || i % 8 == 6);
+
+        auto loads = part_loads(reg);
+        assert(lotus::reload("piece0", reg));
+        wait_loads(reg, loads + 1 + users);
+    }
+    part_pipeline = nullptr;
+}
+
+int main() {
+    published_after_dependencies();
+    reload_cascades();
+    pipeline_cascade();
+
+    std::printf("dependency_test: ok\n");
+    return 0;
+}
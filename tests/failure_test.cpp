@@ -0,0 +1,118 @@
+// failure_test - failed loads cached until their backoff passes, growing backoff, and failed refreshes
+//
+// build: c++ -std=c++17 -g -fsanitize=address,undefined -Iinclude tests/failure_test.cpp -o failure_test -pthread
+
+#undef NDEBUG
+#include <lotus/lotus.hpp>
+
+#include <atomic>
+#include <thread>
+#include <cassert>
+#include <cstdio>
+
+struct resource {
+    int version;
+};
+
+using registry = lotus::resource_registry<resource>;
+using S        = lotus::registry_stats;
+
+static std::atomic<int>     calls{0};
+static std::atomic<int>     versions{0};
+static std::atomic<bool>    failing{true};
+
+static void load(const char*, registry&, lotus::load_token<resource> token) {
+    calls++;
+    if (failing) return lotus::fail(token, "boom");
+    lotus::complete(token, new resource{++versions});
+}
+
+static void unload(resource* object) {
+    delete object;
+}
+
+static void sleep_ms(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static std::uint64_t counter(registry& reg, S::counter c) {
+    return lotus::stats(reg).counters[c];
+}
+
+//=================
+// Cases
+
+//backoff of 50ms, doubling up to 120ms; sleeps leave 20ms or more of margin around every deadline
+static void negative_cache() {
+    registry reg(load, unload);
+    lotus::set_retry_policy(reg, {50000000, 120000000, 2});
+
+    auto h = lotus::get("bad", reg);
+    assert(h.failed() && !h.good() && h.error() == "boom");
+    assert(calls == 1 && counter(reg, S::failures) == 1);
+
+    //answered from the cached failure without calling the loader
+    h = lotus::get("bad", reg);
+    assert(h.failed() && calls == 1 && counter(reg, S::negative_hits) == 1);
+
+    //first backoff 50ms
+    sleep_ms(70);
+    h = lotus::get("bad", reg);
+    assert(h.failed() && calls == 2 && counter(reg, S::failures) == 2);
+
+    //second backoff doubled to 100ms
+    sleep_ms(70);
+    h = lotus::get("bad", reg);
+    assert(h.failed() && calls == 2);
+    sleep_ms(50);
+    h = lotus::get("bad", reg);
+    assert(h.failed() && calls == 3);
+
+    //third backoff capped at 120ms instead of 200ms
+    sleep_ms(90);
+    h = lotus::get("bad", reg);
+    assert(calls == 3);
+    failing = false;
+    sleep_ms(50);
+    h = lotus::get("bad", reg);
+    assert(calls == 4 && h.good() && !h.failed() && h.error().empty());
+
+    //a success resets the backoff to its initial value
+    h = {};
+    failing = true;
+    h = lotus::get("bad", reg);
+    assert(h.failed() && calls == 5);
+    sleep_ms(70);
+    h = lotus::get("bad", reg);
+    assert(calls == 6);
+
+    assert(counter(reg, S::failures) == 5 && counter(reg, S::negative_hits) == 3);
+    failing = false;
+}
+
+//a failed refresh keeps the current object readable and counts the failure
+static void failed_refresh() {
+    registry reg(load, unload);
+
+    failing = false;
+    auto h = lotus::get("config", reg);
+    auto first = h->version;
+
+    failing = true;
+    assert(lotus::refresh("config", reg));
+    assert(h.good() && !h.failed() && h->version == first);
+    assert(counter(reg, S::failures) == 1 && counter(reg, S::refreshes) == 0);
+
+    //a later refresh can still replace it
+    failing = false;
+    assert(lotus::refresh("config", reg));
+    assert(h.good() && h->version > first && counter(reg, S::refreshes) == 1);
+}
+
+int main() {
+    negative_cache();
+    failed_refresh();
+
+    std::printf("failure_test: ok\n");
+    return 0;
+}
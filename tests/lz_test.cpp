@@ -0,0 +1,94 @@
+// lz_test - lz_compress / lz_decompress round trips and malformed input
+//
+// build: c++ -std=c++17 -g -fsanitize=address,undefined -Iinclude tests/lz_test.cpp -o lz_test
+
+#undef NDEBUG
+#include <lotus/lz.hpp>
+
+#include <string>
+#include <random>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+
+static void round_trip(const std::vector<unsigned char>& data) {
+    std::vector<unsigned char> compressed;
+    lotus::lz_compress(data.data(), data.size(), compressed);
+
+    std::vector<unsigned char> restored(data.size());
+    assert(lotus::lz_decompress(compressed.data(), compressed.size(), restored.data(), restored.size()));
+    assert(restored == data);
+
+    //a wrong size is rejected rather than over- or under-filled
+    std::vector<unsigned char> larger(data.size() + 1);
+    assert(!lotus::lz_decompress(compressed.data(), compressed.size(), larger.data(), larger.size()));
+}
+
+//=================
+// Cases
+
+static void sizes_and_contents() {
+    std::mt19937 rng(7);
+
+    for (std::size_t size : {0, 1, 3, 4, 5, 15, 16, 19, 255, 270, 4096, 65536, 70000, 300000}) {
+        std::vector<unsigned char> random(size), repeated(size), text(size);
+
+        for (auto& b : random) b = static_cast<unsigned char>(rng());
+        for (std::size_t i = 0; i < size; i++) repeated[i] = static_cast<unsigned char>(i % 7);
+
+        const std::string words = "lotus resource registry handle load unload ";
+        for (std::size_t i = 0; i < size; i++) text[i] = static_cast<unsigned char>(words[(i * 13 / 11) % words.size()]);
+
+        round_trip(random);
+        round_trip(repeated);
+        round_trip(text);
+    }
+}
+
+//matches far apart are limited by the 64KB window
+static void distant_repeats() {
+    std::mt19937 rng(11);
+
+    std::vector<unsigned char> block(1000);
+    for (auto& b : block) b = static_cast<unsigned char>(rng());
+
+    std::vector<unsigned char> data;
+    for (int i = 0; i < 4; i++) {
+        data.insert(data.end(), block.begin(), block.end());
+        data.resize(data.size() + 40000, static_cast<unsigned char>(i));
+    }
+    round_trip(data);
+
+    std::vector<unsigned char> compressed;
+    lotus::lz_compress(data.data(), data.size(), compressed);
+    assert(compressed.size() < data.size() / 10);
+}
+
+//truncated or corrupted input fails instead of reading or writing out of bounds
+static void malformed() {
+    std::vector<unsigned char> data(20000);
+    for (std::size_t i = 0; i < data.size(); i++) data[i] = static_cast<unsigned char>(i * i >> 5);
+
+    std::vector<unsigned char> compressed;
+    lotus::lz_compress(data.data(), data.size(), compressed);
+
+    std::vector<unsigned char> out(data.size());
+    for (std::size_t cut = 0; cut < compressed.size(); cut += 97)
+        assert(!lotus::lz_decompress(compressed.data(), cut, out.data(), out.size()));
+
+    std::mt19937 rng(3);
+    for (int i = 0; i < 2000; i++) {
+        auto corrupted = compressed;
+        corrupted[rng() % corrupted.size()] ^= static_cast<unsigned char>(1 + rng() % 255);
+        lotus::lz_decompress(corrupted.data(), corrupted.size(), out.data(), out.size());
+    }
+}
+
+int main() {
+    sizes_and_contents();
+    distant_repeats();
+    malformed();
+
+    std::printf("lz_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,182 @@
+// pack_test - pack_writer output read back through pack_reader and pack_registry
+//
+// build: c++ -std=c++17 -g -fsanitize=address,undefined -Iinclude tests/pack_test.cpp -o pack_test -pthread
+
+#undef NDEBUG
+#include <lotus/pack.hpp>
+
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+
+static std::string blob_of(int i) {
+    return std::string(static_cast<std::size_t>(i * 37 % 1000), static_cast<char>('a' + i % 26));
+}
+
+static std::string path_of(const char* name) {
+    return std::string("lotus_pack_test_") + name + ".lpk";
+}
+
+static void write_pack(const std::string& path, int count, std::uint32_t alignment) {
+    lotus::pack_writer writer(path.c_str(), alignment);
+    assert(writer.good());
+
+    for (int i = 0; i < count; i++) {
+        auto data = blob_of(i);
+        assert(writer.add(("blobs/" + std::to_string(i)).c_str(), data.data(), data.size()));
+    }
+    assert(writer.finish());
+}
+
+//=================
+// Cases
+
+static void write_read() {
+    auto path = path_of("read");
+    write_pack(path, 500, 4096);
+
+    lotus::pack_reader reader(path.c_str());
+    assert(reader.good() && reader.count() == 500);
+
+    for (int i = 0; i < 500; i++) {
+        lotus::pack_blob blob;
+        assert(reader.find(("blobs/" + std::to_string(i)).c_str(), blob));
+
+        auto data = blob_of(i);
+        assert(blob.size == data.size() && !std::memcmp(blob.data, data.data(), data.size()));
+        assert(reinterpret_cast<std::uintptr_t>(blob.data) % 4096 == 0);
+    }
+
+    lotus::pack_blob blob;
+    assert(!reader.find("blobs/500", blob) && !reader.find("", blob));
+
+    std::remove(path.c_str());
+}
+
+static void registry() {
+    auto path = path_of("registry");
+    write_pack(path, 50, 64);
+
+    lotus::pack_registry reg(path.c_str());
+    assert(reg.pack().good());
+
+    auto h = lotus::get("blobs/7", reg);
+    assert(h.good() && h->size == blob_of(7).size() && !std::memcmp(h->data, blob_of(7).data(), h->size));
+
+    auto missing = lotus::get("blobs/50", reg);
+    assert(missing.failed() && missing.error() == "not in pack");
+
+    std::remove(path.c_str());
+}
+
+static void write_bytes(const std::string& path, const std::vector<char>& bytes, std::size_t size) {
+    auto file = std::fopen(path.c_str(), "wb");
+    assert(file && std::fwrite(bytes.data(), 1, size, file) == size);
+    std::fclose(file);
+}
+
+template<class T>
+static void patch(std::vector<char>& bytes, std::size_t at, T value) {
+    assert(at + sizeof(T) <= bytes.size());
+    std::memcpy(bytes.data() + at, &value, sizeof(T));
+}
+
+template<class T>
+static T peek(const std::vector<char>& bytes, std::size_t at) {
+    T value;
+    std::memcpy(&value, bytes.data() + at, sizeof(T));
+    return value;
+}
+
+//truncated packs, offsets past the file and offsets wrapping around 64 bits are rejected instead of mapped
+static void malformed() {
+    auto path = path_of("malformed");
+    write_pack(path, 20, 64);
+
+    std::vector<char> bytes;
+    {
+        auto file = std::fopen(path.c_str(), "rb");
+        assert(file);
+        for (int c; (c = std::fgetc(file)) != EOF;) bytes.push_back(static_cast<char>(c));
+        std::fclose(file);
+    }
+
+    auto rejected = [&](const std::vector<char>& patched, std::size_t size) {
+        write_bytes(path, patched, size);
+
+        lotus::pack_reader reader;
+        return !reader.open(path.c_str()) && !reader.good() && reader.count() == 0;
+    };
+
+    assert(!rejected(bytes, bytes.size()));
+
+    for (std::size_t cut : {std::size_t(0), std::size_t(16), bytes.size() / 2, bytes.size() - 1})
+        assert(rejected(bytes, cut));
+
+    using header = lotus::pack_header;
+    using entry  = lotus::pack_entry;
+
+    auto count        = peek<std::uint32_t>(bytes, offsetof(header, count));
+    auto index_offset = peek<std::uint64_t>(bytes, offsetof(header, index_offset));
+    auto first        = static_cast<std::size_t>(index_offset);
+    const std::uint64_t top = ~std::uint64_t(0);
+
+    //an index ending past the end of the address space wraps to a small offset
+    {
+        auto patched = bytes;
+        std::uint64_t offset = top - sizeof(entry) + 1;
+        patch<std::uint32_t>(patched, offsetof(header, count), 2);
+        patch<std::uint64_t>(patched, offsetof(header, index_offset), offset);
+        patch<std::uint64_t>(patched, offsetof(header, names_offset), offset + 2 * sizeof(entry));
+        assert(rejected(patched, patched.size()));
+    }
+    {
+        auto patched = bytes;
+        patch<std::uint32_t>(patched, offsetof(header, count), count + 1000);
+        assert(rejected(patched, patched.size()));
+    }
+
+    //a blob whose end wraps around, or lies past the file
+    {
+        auto patched = bytes;
+        patch<std::uint64_t>(patched, first + offsetof(entry, offset), top - 7);
+        patch<std::uint64_t>(patched, first + offsetof(entry, size), 16);
+        assert(rejected(patched, patched.size()));
+    }
+    {
+        auto patched = bytes;
+        patch<std::uint64_t>(patched, first + offsetof(entry, offset), 64);
+        patch<std::uint64_t>(patched, first + offsetof(entry, size), top - 32);
+        assert(rejected(patched, patched.size()));
+    }
+
+    //a name past the end of the name table
+    {
+        auto patched = bytes;
+        patch<std::uint32_t>(patched, first + offsetof(entry, name_offset), 0xfffffff0u);
+        patch<std::uint32_t>(patched, first + offsetof(entry, name_size), 0x20u);
+        assert(rejected(patched, patched.size()));
+    }
+    {
+        auto patched = bytes;
+        patch<std::uint32_t>(patched, first + (count - 1) * sizeof(entry) + offsetof(entry, name_size), 0xffffu);
+        assert(rejected(patched, patched.size()));
+    }
+
+    lotus::pack_reader reader;
+    assert(!reader.open("lotus_pack_test_missing.lpk"));
+
+    std::remove(path.c_str());
+}
+
+int main() {
+    write_read();
+    registry();
+    malformed();
+
+    std::printf("pack_test: ok\n");
+    return 0;
+}
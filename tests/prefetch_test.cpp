@@ -0,0 +1,111 @@
+// prefetch_test - prefetcher predictions, and prefetched resources letting go once used
+//
+// build: c++ -std=c++17 -g -fsanitize=address,undefined -Iinclude tests/prefetch_test.cpp -o prefetch_test -pthread
+
+#undef NDEBUG
+#include <lotus/prefetcher.hpp>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cassert>
+#include <cstdio>
+
+using registry = lotus::resource_registry<std::string>;
+
+static std::mutex                   mutex;
+static std::map<std::string, int>   alive;  //loaded objects per name
+
+static void load(const char* name, registry&, lotus::load_token<std::string> token) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        alive[name]++;
+    }
+    lotus::complete(token, new std::string(name));
+}
+
+static void unload(std::string* object) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        alive[*object]--;
+    }
+    delete object;
+}
+
+static int alive_of(const char* name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return alive[name];
+}
+
+//waits until the worker issued every queued prediction
+static lotus::prefetch_stats settle(lotus::prefetcher<std::string>& prefetcher) {
+    for (;;) {
+        auto s = prefetcher.stats();
+        if (s.issued + s.dropped >= s.predictions) return s;
+        std::this_thread::yield();
+    }
+}
+
+//=================
+// Cases
+
+//"b" always follows "a"; once learned, getting "a" prefetches "b", and "b" unloads after its caller lets go
+static void used_prefetch_unloads() {
+    registry reg(load, unload);
+    lotus::prefetcher<std::string> prefetcher(reg);
+
+    for (int i = 0; i < 4; i++) {
+        lotus::get("a", reg);
+        lotus::get("b", reg);
+    }
+    settle(prefetcher);
+    prefetcher.drop_unused();
+    assert(alive_of("a") == 0 && alive_of("b") == 0);
+
+    auto before = prefetcher.stats();
+    lotus::get("a", reg);
+
+    settle(prefetcher);
+    assert(alive_of("b") == 1);
+
+    {
+        auto b = lotus::get("b", reg);
+        assert(b.good() && b->compare("b") == 0);
+        assert(prefetcher.stats().hits == before.hits + 1);
+    }
+
+    //neither the prefetcher nor anything else holds "b" any more
+    assert(alive_of("b") == 0);
+}
+
+//unused prefetches are let go by drop_unused and counted as wasted
+static void unused_prefetch_wasted() {
+    registry reg(load, unload);
+    lotus::prefetcher<std::string> prefetcher(reg);
+
+    for (int i = 0; i < 4; i++) {
+        lotus::get("x", reg);
+        lotus::get("y", reg);
+    }
+    settle(prefetcher);
+    prefetcher.drop_unused();
+
+    auto before = prefetcher.stats();
+    lotus::get("x", reg);
+
+    settle(prefetcher);
+    assert(alive_of("y") == 1);
+
+    prefetcher.drop_unused();
+    assert(alive_of("y") == 0);
+    assert(prefetcher.stats().wasted == before.wasted + 1);
+}
+
+int main() {
+    used_prefetch_unloads();
+    unused_prefetch_wasted();
+
+    std::printf("prefetch_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,106 @@
+// publish_test - coarse versions published during a load, reclaimed once replaced unless a pin holds them
+//
+// build: c++ -std=c++17 -g -fsanitize=address,undefined -Iinclude tests/publish_test.cpp -o publish_test -pthread
+
+#undef NDEBUG
+#include <lotus/lotus.hpp>
+
+#include <set>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+
+struct resource {
+    int level;
+};
+
+using registry = lotus::resource_registry<resource>;
+using token    = lotus::load_token<resource>;
+
+static std::set<int>        alive;      //levels of objects not unloaded yet
+static std::vector<token>   pending;    //loads finished by the test
+
+static void load(const char*, registry&, token t) {
+    pending.push_back(t);
+}
+
+static void unload(resource* object) {
+    alive.erase(object->level);
+    delete object;
+}
+
+static resource* make(int level) {
+    alive.insert(level);
+    return new resource{level};
+}
+
+//=================
+// Cases
+
+//a pinned level survives finer ones being published and the final object; unpinned ones go right away
+static void pinned_level_survives() {
+    registry reg(load, unload);
+
+    auto h = lotus::get("mesh", reg);
+    assert(h.loading() && pending.size() == 1);
+    auto t = pending.back();
+
+    assert(lotus::publish(t, make(0), 0));
+    assert(h->level == 0 && !h.good());
+
+    {
+        auto pin = h.pin();
+
+        assert(lotus::publish(t, make(1), 1));
+        assert(h->level == 1 && pin->level == 0);
+        assert(alive.count(0) && alive.count(1));
+
+        //level 1 was never pinned, so level 2 reclaims it at once
+        assert(lotus::publish(t, make(2), 2));
+        assert(h->level == 2 && pin->level == 0);
+        assert(alive.count(0) && !alive.count(1));
+
+        //coarser than the one shown: unloaded without being shown
+        lotus::publish(t, make(1), 1);
+        assert(h->level == 2 && !alive.count(1));
+
+        assert(lotus::complete(t, make(10)));
+        assert(h.good() && h->level == 10 && pin->level == 0);
+        assert(alive == std::set<int>({0, 10}));
+    }
+
+    //the last pin reclaims the old level
+    assert(alive == std::set<int>({10}));
+
+    h = {};
+    assert(alive.empty());
+    pending.clear();
+}
+
+//every handle expiring during the load reclaims the shown level; a pin holds a handle, so it keeps the load going
+static void cancelled_load() {
+    registry reg(load, unload);
+
+    auto h = lotus::get("texture", reg);
+    auto t = pending.back();
+    assert(lotus::publish(t, make(0), 0));
+
+    {
+        auto pin = h.pin();
+        h = {};
+        assert(!t.cancelled() && pin->level == 0);
+    }
+    assert(t.cancelled() && alive.empty());
+
+    assert(!lotus::publish(t, make(1), 1) && !alive.count(1));
+    assert(!lotus::complete(t, make(10)) && alive.empty());
+    pending.clear();
+}
+
+int main() {
+    pinned_level_survives();
+    cancelled_load();
+
+    std::printf("publish_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,20 @@
+#!/bin/sh
+# run.sh - builds every tests/*_test.cpp with address and undefined behavior sanitizers and runs it
+#
+# usage: tests/run.sh [compiler]     run from the repository root; the compiler defaults to c++
+#
+# registries keep their entries until the process exits, so leak checking is off
+
+set -e
+
+cxx=${1:-c++}
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+for test in tests/*_test.cpp; do
+    name=$(basename "$test" .cpp)
+    $cxx -std=c++17 -g -fsanitize=address,undefined -fno-sanitize-recover=undefined -Iinclude "$test" -o "$out/$name" -pthread
+    (cd "$out" && ASAN_OPTIONS=detect_leaks=0 "./$name")
+done
+
+echo "all tests passed"
@@ -0,0 +1,204 @@
+// tiered_test - demotion, spilling, promotion and drops under tier budgets, broken tier copies and invalidate
+//
+// build: c++ -std=c++17 -g -fsanitize=address,undefined -Iinclude tests/tiered_test.cpp -o tiered_test -pthread
+
+#undef NDEBUG
+#include <lotus/tiered.hpp>
+
+#include <string>
+#include <random>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+
+struct blob {
+    std::vector<unsigned char> data;
+};
+
+static bool failing_restore = false;
+
+//random contents, so every blob compresses to about its own size
+static std::vector<unsigned char> contents(const char* name) {
+    std::mt19937 rng(static_cast<unsigned int>(lotus::detail::fnv1a(name, std::strlen(name))));
+    std::vector<unsigned char> data(4096);
+    for (auto& b : data) b = static_cast<unsigned char>(rng());
+    return data;
+}
+
+struct blob_codec {
+    blob* read(const char* name) {
+        return new blob{contents(name)};
+    }
+
+    std::uint64_t size(const blob& b) {
+        return b.data.size();
+    }
+
+    void store(const blob& b, std::vector<unsigned char>& out) {
+        out = b.data;
+    }
+
+    blob* restore(const unsigned char* data, std::size_t size) {
+        if (failing_restore) return nullptr;
+        return new blob{std::vector<unsigned char>(data, data + size)};
+    }
+
+    void destroy(blob* b) {
+        delete b;
+    }
+};
+
+using loader   = lotus::tiered_loader<blob, blob_codec>;
+using registry = lotus::resource_registry<blob, lotus::multi_threaded, loader>;
+
+//compressed size of a blob in the tiers
+static std::uint64_t packed(const char* name) {
+    auto data = contents(name);
+    std::vector<unsigned char> compressed;
+    lotus::lz_compress(data.data(), data.size(), compressed);
+    return compressed.size();
+}
+
+//loads the resource and lets it go; without a resident budget it is unloaded right away
+static void touch(const char* name, registry& reg) {
+    auto h = lotus::get(name, reg);
+    assert(h.good() && h->data == contents(name));
+}
+
+static std::vector<std::string> spill_files(const std::string& dir) {
+    std::vector<std::string> files;
+    auto d = ::opendir(dir.c_str());
+    while (auto e = ::readdir(d))
+        if (e->d_name[0] != '.') files.push_back(dir + "/" + e->d_name);
+    ::closedir(d);
+    return files;
+}
+
+static std::string make_directory() {
+    char path[] = "/tmp/lotus_tiered_XXXXXX";
+    assert(::mkdtemp(path));
+    return path;
+}
+
+//=================
+// Cases
+
+//unloads fill the warm tier; past its budget rarely loaded copies spill, and spilled copies loaded often come back
+static void demote_spill_promote() {
+    auto dir = make_directory();
+    {
+        lotus::tiered_config config;
+        config.warm_bytes   = packed("a") + packed("b");
+        config.cold_bytes   = packed("b") + packed("c") + packed("d");
+        config.directory    = dir;
+        config.promote_hits = 2;
+        registry reg(config);
+
+        touch("a", reg);
+        touch("b", reg);
+        auto s = reg.loader().stats();
+        assert(s.source_reads == 2 && s.demotions == 2 && s.spills == 0);
+        assert(s.warm_bytes == packed("a") + packed("b"));
+
+        //c doesn't fit: the oldest copy spills to disk
+        touch("c", reg);
+        s = reg.loader().stats();
+        assert(s.spills == 1 && s.cold_bytes == packed("a") && spill_files(dir).size() == 1);
+        assert(s.warm_bytes == packed("b") + packed("c"));
+
+        //a warm copy is restored without reading the source
+        touch("b", reg);
+        s = reg.loader().stats();
+        assert(s.warm_hits == 1 && s.source_reads == 3);
+
+        //a's second load promotes it; b was loaded twice, so c spills in its place
+        touch("a", reg);
+        s = reg.loader().stats();
+        assert(s.cold_hits == 1 && s.promotions == 1 && s.spills == 2);
+        assert(s.warm_bytes == packed("a") + packed("b") && s.cold_bytes == packed("c"));
+        assert(spill_files(dir).size() == 1);
+
+        //over the cold budget spill files are deleted
+        touch("d", reg);
+        touch("e", reg);
+        touch("f", reg);
+        s = reg.loader().stats();
+        assert(s.drops >= 1 && s.cold_bytes <= config.cold_bytes && s.warm_bytes <= config.warm_bytes);
+        assert(spill_files(dir).size() == s.spills - s.promotions - s.drops);
+
+        //shrinking the budgets spills and drops at once
+        reg.loader().set_budgets(0, 0);
+        s = reg.loader().stats();
+        assert(s.warm_bytes == 0 && s.cold_bytes == 0 && spill_files(dir).empty());
+
+        touch("a", reg);
+        assert(reg.loader().stats().source_reads == 7);
+    }
+    assert(spill_files(dir).empty());
+    ::rmdir(dir.c_str());
+}
+
+//copies that fail to restore are dropped, so the next unload stores a good one instead of reading the source forever
+static void broken_copies() {
+    auto dir = make_directory();
+    {
+        lotus::tiered_config config;
+        config.directory = dir;
+        registry reg(config);
+
+        touch("a", reg);
+        failing_restore = true;
+        touch("a", reg);
+        failing_restore = false;
+
+        auto s = reg.loader().stats();
+        assert(s.source_reads == 2 && s.warm_hits == 0 && s.demotions == 2);
+        touch("a", reg);
+        assert(reg.loader().stats().warm_hits == 1);
+
+        //a spill file cut short fails to decompress
+        reg.loader().set_budgets(0, 1 << 20);
+        auto files = spill_files(dir);
+        assert(files.size() == 1);
+        assert(::truncate(files[0].c_str(), 64) == 0);
+
+        //the broken file is deleted and the object unloaded spills a new one
+        touch("a", reg);
+        s = reg.loader().stats();
+        assert(s.cold_hits == 0 && s.source_reads == 3 && s.demotions == 3 && s.cold_bytes == packed("a"));
+        assert(spill_files(dir).size() == 1 && spill_files(dir)[0] != files[0]);
+    }
+    ::rmdir(dir.c_str());
+}
+
+//an invalidated resource isn't stored again when its loaded object is unloaded
+static void invalidate() {
+    lotus::tiered_config config;
+    registry reg(config);
+
+    touch("a", reg);
+    {
+        auto h = lotus::get("a", reg);
+        reg.loader().invalidate("a");
+        assert(reg.loader().stats().warm_bytes == 0);
+    }
+
+    auto s = reg.loader().stats();
+    assert(s.demotions == 1 && s.warm_bytes == 0);
+
+    touch("a", reg);
+    assert(reg.loader().stats().source_reads == 2);
+}
+
+int main() {
+    demote_spill_promote();
+    broken_copies();
+    invalidate();
+
+    std::printf("tiered_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,203 @@
+// ttl_test - timer wheel levels and cascades, ttl eviction, background refresh and removing a ttl
+//
+// build: c++ -std=c++17 -g -fsanitize=address,undefined -Iinclude tests/ttl_test.cpp -o ttl_test -pthread
+
+#undef NDEBUG
+#include <lotus/lotus.hpp>
+
+#include <map>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+
+struct resource {
+    std::string name;
+    int         version;
+};
+
+using registry = lotus::resource_registry<resource>;
+
+static std::atomic<int> alive{0};
+static std::atomic<int> versions{0};
+
+static void load(const char* name, registry&, lotus::load_token<resource> token) {
+    alive++;
+    lotus::complete(token, new resource{name, ++versions}, 1);
+}
+
+static void unload(resource* object) {
+    alive--;
+    delete object;
+}
+
+//a few 10ms ticks of the expiry wheel
+static void wait_ticks(int ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10 * ticks + 5));
+}
+
+//=================
+// Timer Wheel
+
+//every timer fires exactly on its tick, whether advanced a tick at a time or across many levels at once
+static void wheel_levels() {
+    const std::uint64_t deadlines[] = {
+        1, 2, 255, 256, 257, 300, 511, 512, 16383, 16384, 16385, 20000, 1u << 20, (1u << 20) + 1, (1u << 26) - 1
+    };
+
+    for (std::uint64_t step : {1ull, 7ull, 255ull, 1000ull, 1ull << 22, 1ull << 27}) {
+        lotus::timer_wheel<std::uint64_t> wheel;
+        for (auto d : deadlines) wheel.schedule(d, d);
+
+        std::vector<std::uint64_t> fired;
+        for (std::uint64_t tick = 0; wheel.size();) {
+            tick += step;
+            wheel.advance(tick, [&](std::uint64_t d) {
+                //a big step processes every tick in between, so timers still see their own tick
+                assert(wheel.tick() == d);
+                fired.push_back(d);
+            });
+        }
+
+        assert(fired.size() == sizeof(deadlines) / sizeof(deadlines[0]));
+        for (std::size_t i = 0; i < fired.size(); i++) assert(fired[i] == deadlines[i]);
+    }
+}
+
+//timers scheduled while the wheel is far along still cascade through the levels at the right time
+static void wheel_random() {
+    std::mt19937_64 rng(5);
+    lotus::timer_wheel<std::uint64_t> wheel;
+    std::multimap<std::uint64_t, std::uint64_t> expected;
+
+    std::uint64_t now = 0;
+    for (int round = 0; round < 2000; round++) {
+        for (int i = 0; i < 4; i++) {
+            auto delay = 1 + rng() % (1ull << (rng() % 25));
+            wheel.schedule(now + delay, now + delay);
+            expected.insert({now + delay, now + delay});
+        }
+
+        now += rng() % (1ull << (rng() % 18));
+        wheel.advance(now, [&](std::uint64_t d) {
+            assert(wheel.tick() == d && expected.begin()->first == d);
+            expected.erase(expected.begin());
+        });
+        assert(expected.empty() || expected.begin()->first > now);
+        assert(wheel.size() == expected.size());
+    }
+}
+
+//deadlines past the last level fire at the end of its range; due ones fire on the next tick
+static void wheel_bounds() {
+    lotus::timer_wheel<int> wheel;
+    wheel.advance(100, [](int) { assert(false); });
+
+    int fired = 0;
+    wheel.schedule(50, 1);
+    wheel.advance(101, [&](int) { fired++; });
+    assert(fired == 1);
+
+    wheel.schedule(101 + (1ull << 30), 2);
+    wheel.advance(101 + (1ull << 26) - 2, [&](int) { fired++; });
+    assert(fired == 1);
+    wheel.advance(101 + (1ull << 26), [&](int) { fired++; });
+    assert(fired == 2 && wheel.size() == 0);
+}
+
+//=================
+// Expiry
+
+//only resources nobody holds a handle to are evicted; held ones stay loaded
+static void evict_unreferenced() {
+    registry reg(load, unload);
+    lotus::set_resident_budget(reg, 100);
+    lotus::set_ttl(reg, "e/", 20000000, lotus::expiry_action::evict);
+
+    auto held = lotus::get("e/held", reg);
+    lotus::get("e/idle", reg);
+    lotus::get("kept", reg);
+    assert(alive == 3);
+
+    wait_ticks(3);
+    assert(lotus::expire(reg) == 2);
+    assert(held.good() && alive == 2);
+
+    //the idle resource is gone, the one without a rule is still kept by the budget
+    auto loads = lotus::stats(reg).counters[lotus::registry_stats::loads];
+    lotus::get("kept", reg);
+    lotus::get("e/idle", reg);
+    assert(lotus::stats(reg).counters[lotus::registry_stats::loads] == loads + 1);
+
+    held = {};
+    lotus::set_resident_budget(reg, 0);
+    assert(alive == 0);
+}
+
+//a refresh swaps the object under held handles; pinned readers keep the old one until they unpin
+static void refresh_held() {
+    registry reg(load, unload);
+    lotus::set_ttl(reg, "r/", 20000000, lotus::expiry_action::refresh);
+
+    auto h = lotus::get("r/config", reg);
+    auto first = h->version;
+    {
+        auto pin = h.pin();
+
+        wait_ticks(3);
+        assert(lotus::expire(reg) == 1);
+
+        //the loader is synchronous, so the refresh already published
+        assert(h.good() && h->version > first && h->name == "r/config");
+        assert(pin->version == first && alive == 2);
+    }
+    assert(alive == 1);
+
+    //refreshed resources get a new ttl
+    auto second = h->version;
+    wait_ticks(3);
+    assert(lotus::expire(reg) == 1 && h->version > second && alive == 1);
+
+    h = {};
+    assert(alive == 0);
+}
+
+//removing a rule drops expiries pending under it
+static void remove_ttl() {
+    registry reg(load, unload);
+    lotus::set_resident_budget(reg, 100);
+    lotus::set_ttl(reg, "c/", 20000000, lotus::expiry_action::evict);
+    lotus::set_ttl(reg, "c/keep/", 20000000, lotus::expiry_action::evict);
+
+    lotus::get("c/keep/a", reg);
+    lotus::get("c/b", reg);
+    lotus::set_ttl(reg, "c/keep/", 0, lotus::expiry_action::evict);
+
+    //"c/keep/a" now falls under the shorter "c/" rule, which still holds
+    wait_ticks(3);
+    assert(lotus::expire(reg) == 2 && alive == 0);
+
+    lotus::get("c/keep/a", reg);
+    lotus::set_ttl(reg, "c/", 0, lotus::expiry_action::evict);
+
+    wait_ticks(3);
+    assert(lotus::expire(reg) == 0 && alive == 1);
+
+    lotus::set_resident_budget(reg, 0);
+    assert(alive == 0);
+}
+
+int main() {
+    wheel_levels();
+    wheel_random();
+    wheel_bounds();
+    evict_unreferenced();
+    refresh_held();
+    remove_ttl();
+
+    std::printf("ttl_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,598 @@
+// lotus_cachesim - simulates cache policies over a recorded workload (see lotus/recorder.hpp), printed as json
+//
+// usage: lotus_cachesim <recording.ltr> [options]
+//   --sizes <file>        text file of "name size [cost]" lines; unlisted resources have size 1 and cost 1
+//   --manifest <file>     takes load costs from load times of a hot-set manifest (see lotus/manifest.hpp)
+//   --points <n>          budgets, spaced logarithmically from 1/1024 of the working set to all of it (16)
+//   --budgets <a,b,...>   explicit budgets instead of --points
+//   --policies <a,b,...>  subset of lru,clock,arc,wtinylfu,gds (all)
+//
+// budgets are in the units of sizes; with no --sizes they count resources. every "get" of the recording is
+// one access; a miss costs the resource's load cost, and reload cost sums the misses of resources that were
+// loaded before (compulsory misses excluded). lru curves come from a single stack distance pass, the other
+// policies run one simulated cache per budget in the same pass over the trace. peak_pinned is the largest
+// total size of resources that had live handles at once; no policy can hold a budget below it
+//
+// build: c++ -std=c++17 -O2 -DNDEBUG -Iinclude tools/lotus_cachesim.cpp -o lotus_cachesim
+
+#include <lotus/recorder.hpp>
+#include <lotus/manifest.hpp>
+
+#include <set>
+#include <cmath>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+//=================
+// Trace
+
+struct access {
+    std::uint32_t   id;
+    bool            first;  //compulsory miss under every policy
+};
+
+static std::vector<std::uint64_t>   sizes;
+static std::vector<double>          costs;
+
+//=================
+// Policies
+
+// cache of a fixed budget; access returns whether it was a hit and admits the resource on a miss
+struct cache_policy {
+    virtual ~cache_policy() {}
+    virtual bool access(std::uint32_t id) = 0;
+};
+
+// doubly linked lists threaded through per-resource arrays; a resource is in at most one list of a set
+struct list_set {
+    static constexpr std::uint32_t none = 0xffffffff;
+
+    struct list {
+        std::uint32_t head = none, tail = none;    //head is the most recently used end
+        std::uint64_t bytes = 0;
+    };
+
+    std::vector<std::uint32_t>  prev, next;
+    std::vector<std::uint8_t>   owner;              //list index + 1; 0 when in no list
+    std::vector<list>           lists;
+
+    list_set(std::size_t ids, std::size_t list_count)
+        : prev(ids, none), next(ids, none), owner(ids, 0), lists(list_count) {}
+
+    int which(std::uint32_t id) const { return owner[id] - 1; }
+
+    void push_front(int l, std::uint32_t id) {
+        auto& L = lists[l];
+        prev[id] = none;
+        next[id] = L.head;
+        if (L.head != none) prev[L.head] = id;
+        else L.tail = id;
+        L.head = id;
+        L.bytes += sizes[id];
+        owner[id] = static_cast<std::uint8_t>(l + 1);
+    }
+
+    void remove(std::uint32_t id) {
+        auto& L = lists[which(id)];
+        if (prev[id] != none) next[prev[id]] = next[id];
+        else L.head = next[id];
+        if (next[id] != none) prev[next[id]] = prev[id];
+        else L.tail = prev[id];
+        L.bytes -= sizes[id];
+        owner[id] = 0;
+    }
+
+    //removes and returns the least recently used resource, or none
+    std::uint32_t pop_back(int l) {
+        auto id = lists[l].tail;
+        if (id != none) remove(id);
+        return id;
+    }
+
+    std::uint64_t bytes(int l) const { return lists[l].bytes; }
+    bool empty(int l) const { return lists[l].head == none; }
+};
+
+// second chance ring; referenced resources survive one pass of the hand
+struct clock_policy : cache_policy {
+    struct slot {
+        std::uint32_t   id;
+        bool            referenced;
+    };
+
+    std::uint64_t               budget, used = 0;
+    std::vector<std::int64_t>   slot_of;
+    std::vector<slot>           ring;
+    std::vector<std::size_t>    free_slots;
+    std::size_t                 hand = 0;
+
+    clock_policy(std::size_t ids, std::uint64_t _budget) : budget(_budget), slot_of(ids, -1) {}
+
+    bool access(std::uint32_t id) override {
+        if (slot_of[id] >= 0) {
+            ring[slot_of[id]].referenced = true;
+            return true;
+        }
+
+        if (sizes[id] > budget) return false;
+
+        while (used + sizes[id] > budget) {
+            if (hand >= ring.size()) hand = 0;
+            auto& s = ring[hand];
+
+            if (s.id != list_set::none) {
+                if (s.referenced) s.referenced = false;
+                else {
+                    used -= sizes[s.id];
+                    slot_of[s.id] = -1;
+                    s.id = list_set::none;
+                    free_slots.push_back(hand);
+                }
+            }
+            hand++;
+        }
+
+        std::size_t index;
+        if (!free_slots.empty()) {
+            index = free_slots.back();
+            free_slots.pop_back();
+            ring[index] = {id, false};
+        }
+        else {
+            index = ring.size();
+            ring.push_back({id, false});
+        }
+
+        slot_of[id] = static_cast<std::int64_t>(index);
+        used += sizes[id];
+        return false;
+    }
+};
+
+// adaptive replacement cache (Megiddo, Modha) with lists and the target measured in bytes
+struct arc_policy : cache_policy {
+    enum { t1, t2, b1, b2 };
+
+    std::uint64_t   budget;
+    double          target = 0;     //desired bytes of t1
+    list_set        lists;
+
+    arc_policy(std::size_t ids, std::uint64_t _budget) : budget(_budget), lists(ids, 4) {}
+
+    //moves one resident resource to its ghost list
+    void replace(bool in_b2) {
+        auto t1_bytes = static_cast<double>(lists.bytes(t1));
+        bool from_t1 = !lists.empty(t1) && (t1_bytes > target || (in_b2 && t1_bytes == target) || lists.empty(t2));
+
+        auto id = lists.pop_back(from_t1 ? t1 : t2);
+        lists.push_front(from_t1 ? b1 : b2, id);
+    }
+
+    bool access(std::uint32_t id) override {
+        int l = lists.which(id);
+        auto size = static_cast<double>(sizes[id]);
+
+        if (l == t1 || l == t2) {
+            lists.remove(id);
+            lists.push_front(t2, id);
+            return true;
+        }
+
+        if (sizes[id] > budget) return false;
+
+        if (l == b1) {
+            double ratio = std::max(1.0, static_cast<double>(lists.bytes(b2)) / std::max<std::uint64_t>(1, lists.bytes(b1)));
+            target = std::min(static_cast<double>(budget), target + ratio * size);
+        }
+        else if (l == b2) {
+            double ratio = std::max(1.0, static_cast<double>(lists.bytes(b1)) / std::max<std::uint64_t>(1, lists.bytes(b2)));
+            target = std::max(0.0, target - ratio * size);
+        }
+        if (l >= 0) lists.remove(id);
+
+        while (lists.bytes(t1) + lists.bytes(t2) + sizes[id] > budget) replace(l == b2);
+
+        //ghosts remember at most a budget of t1 history and a budget of total history
+        while (lists.bytes(t1) + lists.bytes(b1) > budget && !lists.empty(b1)) lists.pop_back(b1);
+        while (lists.bytes(t1) + lists.bytes(t2) + lists.bytes(b1) + lists.bytes(b2) > 2 * budget) {
+            if (!lists.empty(b2)) lists.pop_back(b2);
+            else if (!lists.empty(b1)) lists.pop_back(b1);
+            else break;
+        }
+
+        lists.push_front(l == b1 || l == b2 ? t2 : t1, id);
+        return false;
+    }
+};
+
+// window lru in front of a segmented lru main cache, admitting by count-min sketch frequency (Einziger et al.)
+struct wtinylfu_policy : cache_policy {
+    enum { window, probation, protect };
+
+    static constexpr int rows = 4;
+
+    std::uint64_t               budget, window_budget, main_budget, protect_budget;
+    list_set                    lists;
+
+    std::vector<std::uint8_t>   sketch;     //4 rows of saturating counters
+    std::uint64_t               mask;
+    std::uint64_t               additions = 0, sample;
+
+    wtinylfu_policy(std::size_t ids, std::uint64_t _budget, std::uint64_t average_size)
+        : budget(_budget), lists(ids, 3) {
+        window_budget  = std::max<std::uint64_t>(1, budget / 100);
+        main_budget    = budget > window_budget ? budget - window_budget : 0;
+        protect_budget = main_budget * 8 / 10;
+
+        std::uint64_t entries = std::max<std::uint64_t>(16, budget / std::max<std::uint64_t>(1, average_size));
+        std::uint64_t width = 16;
+        while (width < entries) width <<= 1;
+
+        sketch.assign(rows * width, 0);
+        mask   = width - 1;
+        sample = 10 * entries;
+    }
+
+    std::uint64_t index(int row, std::uint32_t id) const {
+        std::uint64_t h = (id + 1) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> (17 + row * 7);
+        h *= 0xbf58476d1ce4e5b9ull + row * 2;
+        return row * (mask + 1) + ((h >> 32) & mask);
+    }
+
+    unsigned int frequency(std::uint32_t id) const {
+        unsigned int f = 15;
+        for (int r = 0; r < rows; r++) f = std::min<unsigned int>(f, sketch[index(r, id)]);
+        return f;
+    }
+
+    //counters are halved every sample additions, so old popularity fades
+    void increment(std::uint32_t id) {
+        for (int r = 0; r < rows; r++) {
+            auto& c = sketch[index(r, id)];
+            if (c < 15) c++;
+        }
+
+        if (++additions == sample) {
+            for (auto& c : sketch) c >>= 1;
+            additions /= 2;
+        }
+    }
+
+    //the candidate must be more frequent than every resource evicted to make room for it, otherwise nothing changes
+    void admit(std::uint32_t candidate) {
+        if (sizes[candidate] > main_budget) return;
+
+        std::vector<std::uint32_t> victims;
+        std::uint64_t used = lists.bytes(probation) + lists.bytes(protect);
+        auto f = frequency(candidate);
+
+        //least recently used first: probation from its tail, then protected; the candidate fits once both are walked
+        auto v = lists.empty(probation) ? lists.lists[protect].tail : lists.lists[probation].tail;
+        while (used + sizes[candidate] > main_budget) {
+            if (f <= frequency(v)) return;
+
+            victims.push_back(v);
+            used -= sizes[v];
+
+            v = lists.prev[v];
+            if (v == list_set::none && lists.which(victims.back()) == probation) v = lists.lists[protect].tail;
+        }
+
+        for (auto id : victims) lists.remove(id);
+        lists.push_front(probation, candidate);
+    }
+
+    bool access(std::uint32_t id) override {
+        increment(id);
+
+        switch (lists.which(id)) {
+        case window:
+            lists.remove(id);
+            lists.push_front(window, id);
+            return true;
+        case probation:
+            lists.remove(id);
+            lists.push_front(protect, id);
+            while (lists.bytes(protect) > protect_budget) lists.push_front(probation, lists.pop_back(protect));
+            return true;
+        case protect:
+            lists.remove(id);
+            lists.push_front(protect, id);
+            return true;
+        }
+
+        if (sizes[id] > budget) return false;
+
+        lists.push_front(window, id);
+        while (lists.bytes(window) > window_budget) admit(lists.pop_back(window));
+        return false;
+    }
+};
+
+// GreedyDual-Size (Cao, Irani): evicts the lowest cost / size, aged by the priority of the last eviction
+struct gds_policy : cache_policy {
+    std::uint64_t                               budget, used = 0;
+    double                                      inflation = 0;
+    std::vector<double>                         priority;
+    std::vector<bool>                           resident;
+    std::set<std::pair<double, std::uint32_t>>  queue;
+
+    gds_policy(std::size_t ids, std::uint64_t _budget) : budget(_budget), priority(ids, 0), resident(ids, false) {}
+
+    bool access(std::uint32_t id) override {
+        bool hit = resident[id];
+        if (hit) queue.erase({priority[id], id});
+        else {
+            if (sizes[id] > budget) return false;
+
+            while (used + sizes[id] > budget) {
+                auto lowest = *queue.begin();
+                queue.erase(queue.begin());
+                inflation = lowest.first;
+                resident[lowest.second] = false;
+                used -= sizes[lowest.second];
+            }
+
+            resident[id] = true;
+            used += sizes[id];
+        }
+
+        priority[id] = inflation + costs[id] / static_cast<double>(sizes[id]);
+        queue.insert({priority[id], id});
+        return hit;
+    }
+};
+
+//=================
+// Curves
+
+struct curve_point {
+    std::uint64_t   budget;
+    std::uint64_t   misses      = 0;
+    double          reload_cost = 0;
+};
+
+// byte stack distances (Mattson et al.) over a Fenwick tree of sizes at each resource's latest access,
+// giving lru misses at every budget in one pass
+static void lru_curve(const std::vector<access>& trace, std::vector<curve_point>& points) {
+    std::vector<std::uint64_t> tree(trace.size() + 1, 0);
+    auto add = [&](std::size_t i, std::int64_t v) {
+        for (i++; i < tree.size(); i += i & (0 - i)) tree[i] += v;
+    };
+    auto prefix = [&](std::size_t i) {    //sum of [0, i)
+        std::uint64_t s = 0;
+        for (; i > 0; i -= i & (0 - i)) s += tree[i];
+        return s;
+    };
+
+    std::vector<std::int64_t> last(sizes.size(), -1);
+    std::vector<std::uint64_t> hits(points.size() + 1, 0);
+    std::vector<double> hit_cost(points.size() + 1, 0);
+
+    for (std::size_t t = 0; t < trace.size(); t++) {
+        auto id = trace[t].id;
+
+        if (last[id] >= 0) {
+            //bytes of distinct resources used since the previous access, this one included
+            auto distance = prefix(t) - prefix(last[id]);
+            add(last[id], -static_cast<std::int64_t>(sizes[id]));
+
+            //first budget large enough to hit; every larger one hits as well
+            auto first = std::lower_bound(points.begin(), points.end(), distance,
+                [](const curve_point& p, std::uint64_t d) { return p.budget < d; }) - points.begin();
+            hits[first]++;
+            hit_cost[first] += costs[id];
+        }
+
+        add(t, sizes[id]);
+        last[id] = static_cast<std::int64_t>(t);
+    }
+
+    //every hit is on a resource seen before, so it saves a reload
+    double reload_cost = 0;
+    for (auto& a : trace) if (!a.first) reload_cost += costs[a.id];
+
+    std::uint64_t total_hits = 0;
+    double total_hit_cost = 0;
+
+    for (std::size_t i = 0; i < points.size(); i++) {
+        total_hits += hits[i];
+        total_hit_cost += hit_cost[i];
+        points[i].misses = trace.size() - total_hits;
+        points[i].reload_cost = reload_cost - total_hit_cost;
+    }
+}
+
+//=================
+// Main
+
+static int usage() {
+    std::cerr << "usage: lotus_cachesim <recording.ltr> [--sizes <file>] [--manifest <file>] [--points <n>] "
+                 "[--budgets <a,b,...>] [--policies <a,b,...>]\n";
+    return 2;
+}
+
+static std::vector<std::string> split(const std::string& s) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    for (std::string item; std::getline(ss, item, ',');) if (!item.empty()) out.push_back(item);
+    return out;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return usage();
+
+    const char*                 sizes_file    = nullptr;
+    const char*                 manifest_file = nullptr;
+    unsigned int                point_count   = 16;
+    std::vector<std::uint64_t>  budgets;
+    std::vector<std::string>    policies      = {"lru", "clock", "arc", "wtinylfu", "gds"};
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return usage();
+
+        if      (arg == "--sizes")      sizes_file    = argv[++i];
+        else if (arg == "--manifest")   manifest_file = argv[++i];
+        else if (arg == "--points")     point_count   = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--budgets")    for (auto& b : split(argv[++i])) budgets.push_back(std::strtoull(b.c_str(), nullptr, 10));
+        else if (arg == "--policies")   policies      = split(argv[++i]);
+        else return usage();
+    }
+
+    lotus::recording rec;
+    if (!lotus::load_recording(argv[1], rec)) {
+        std::cerr << "can't read recording " << argv[1] << "\n";
+        return 1;
+    }
+
+    std::unordered_map<std::string, std::uint32_t> ids;
+    for (std::uint32_t i = 0; i < rec.names.size(); i++) ids[rec.names[i]] = i;
+
+    sizes.assign(rec.names.size(), 1);
+    costs.assign(rec.names.size(), 1);
+
+    if (manifest_file) {
+        std::vector<lotus::resource_info> entries;
+        if (!lotus::load_manifest(manifest_file, entries)) {
+            std::cerr << "can't read manifest " << manifest_file << "\n";
+            return 1;
+        }
+        for (auto& e : entries) {
+            auto itr = ids.find(e.name);
+            if (itr != ids.end() && e.load_time) costs[itr->second] = static_cast<double>(e.load_time);
+        }
+    }
+
+    if (sizes_file) {
+        std::ifstream in(sizes_file);
+        if (!in) {
+            std::cerr << "can't read sizes " << sizes_file << "\n";
+            return 1;
+        }
+
+        for (std::string line; std::getline(in, line);) {
+            std::istringstream fields(line);
+            std::string name;
+            std::uint64_t size;
+            double cost;
+
+            if (!(fields >> name >> size)) continue;
+            auto itr = ids.find(name);
+            if (itr == ids.end()) continue;
+
+            sizes[itr->second] = std::max<std::uint64_t>(1, size);
+            if (fields >> cost) costs[itr->second] = cost;
+        }
+    }
+
+    //accesses in recorded order over all threads; live handles tracked along the way
+    struct timed {
+        std::uint64_t               time;
+        const lotus::recorded_event* event;
+    };
+    std::vector<timed> merged;
+    for (auto& t : rec.threads) for (auto& e : t.events) merged.push_back({e.time, &e});
+    std::stable_sort(merged.begin(), merged.end(), [](const timed& a, const timed& b) { return a.time < b.time; });
+
+    std::vector<access> trace;
+    std::vector<bool> seen(rec.names.size(), false), pinned(rec.names.size(), false);
+    std::uint64_t working_set = 0, pinned_bytes = 0, peak_pinned = 0;
+
+    for (auto& m : merged) {
+        auto& e = *m.event;
+        if (e.name == lotus::recorded_event::no_name) continue;
+
+        if (e.event == lotus::registry_event::get) {
+            trace.push_back({e.name, !seen[e.name]});
+            if (!seen[e.name]) working_set += sizes[e.name];
+            seen[e.name] = true;
+
+            if (!pinned[e.name]) {
+                pinned[e.name] = true;
+                pinned_bytes += sizes[e.name];
+                peak_pinned = std::max(peak_pinned, pinned_bytes);
+            }
+        }
+        else if (e.event == lotus::registry_event::release && pinned[e.name]) {
+            pinned[e.name] = false;
+            pinned_bytes -= sizes[e.name];
+        }
+    }
+
+    if (budgets.empty()) {
+        for (unsigned int i = 0; i < point_count; i++) {
+            double exponent = point_count > 1 ? static_cast<double>(i) / (point_count - 1) - 1.0 : 0.0;
+            auto b = static_cast<std::uint64_t>(std::llround(working_set * std::pow(1024.0, exponent)));
+            budgets.push_back(std::max<std::uint64_t>(1, b));
+        }
+    }
+    std::sort(budgets.begin(), budgets.end());
+    budgets.erase(std::unique(budgets.begin(), budgets.end()), budgets.end());
+
+    std::uint64_t average_size = working_set / std::max<std::size_t>(1, std::count(seen.begin(), seen.end(), true));
+
+    //lru from stack distances, the others simulated side by side in a single pass
+    std::vector<std::string> simulated;
+    std::vector<std::vector<std::unique_ptr<cache_policy>>> caches;
+    std::vector<std::vector<curve_point>> curves;
+
+    for (auto& p : policies) {
+        std::vector<curve_point> points;
+        for (auto b : budgets) points.push_back({b});
+
+        std::vector<std::unique_ptr<cache_policy>> per_budget;
+        for (auto b : budgets) {
+            if      (p == "lru")        break;
+            else if (p == "clock")      per_budget.emplace_back(new clock_policy(sizes.size(), b));
+            else if (p == "arc")        per_budget.emplace_back(new arc_policy(sizes.size(), b));
+            else if (p == "wtinylfu")   per_budget.emplace_back(new wtinylfu_policy(sizes.size(), b, average_size));
+            else if (p == "gds")        per_budget.emplace_back(new gds_policy(sizes.size(), b));
+            else {
+                std::cerr << "unknown policy " << p << "\n";
+                return 2;
+            }
+        }
+
+        if (p == "lru") lru_curve(trace, points);
+
+        simulated.push_back(p);
+        curves.push_back(points);
+        caches.push_back(std::move(per_budget));
+    }
+
+    for (auto& a : trace) {
+        for (std::size_t p = 0; p < caches.size(); p++) {
+            for (std::size_t b = 0; b < caches[p].size(); b++) {
+                if (caches[p][b]->access(a.id)) continue;
+
+                curves[p][b].misses++;
+                if (!a.first) curves[p][b].reload_cost += costs[a.id];
+            }
+        }
+    }
+
+    std::printf("{\n");
+    std::printf("  \"accesses\": %zu, \"resources\": %llu, \"working_set\": %llu, \"peak_pinned\": %llu,\n",
+        trace.size(), (unsigned long long)std::count(seen.begin(), seen.end(), true),
+        (unsigned long long)working_set, (unsigned long long)peak_pinned);
+    std::printf("  \"curves\": [\n");
+    for (std::size_t p = 0; p < curves.size(); p++) {
+        std::printf("    {\"policy\": \"%s\", \"points\": [\n", simulated[p].c_str());
+        for (std::size_t b = 0; b < curves[p].size(); b++) {
+            auto& pt = curves[p][b];
+            std::printf("      {\"budget\": %llu, \"miss_ratio\": %.6f, \"reload_cost\": %.1f}%s\n",
+                (unsigned long long)pt.budget, trace.empty() ? 0.0 : static_cast<double>(pt.misses) / trace.size(),
+                pt.reload_cost, b + 1 < curves[p].size() ? "," : "");
+        }
+        std::printf("    ]}%s\n", p + 1 < curves.size() ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+    return 0;
+}
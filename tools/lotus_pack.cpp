@@ -0,0 +1,147 @@
+// lotus_pack - builds a lotus pack from a directory tree or another pack
+//
+// usage: lotus_pack <output.lpk> <input_dir | input.lpk> [--align <bytes>] [--order <session.ltr>]
+// resource names are paths relative to input_dir, separated with '/'
+//
+// --order lays blobs out in first-use order taken from a recorded run (see lotus/recorder.hpp),
+// so resources requested together end up next to each other; unlisted ones follow sorted by name
+//
+// build: c++ -std=c++17 -O2 -Iinclude tools/lotus_pack.cpp -o lotus_pack
+
+#include <lotus/pack.hpp>
+#include <lotus/recorder.hpp>
+
+#include <map>
+#include <memory>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static int usage() {
+    std::cerr << "usage: lotus_pack <output.lpk> <input_dir | input.lpk> [--align <bytes>] [--order <session.ltr>]\n";
+    return 2;
+}
+
+// blob source; either a file on disk or a blob of the input pack
+struct source {
+    fs::path            path;
+    lotus::pack_blob    blob = {nullptr, 0};
+};
+
+int main(int argc, char** argv) {
+    if (argc < 3) return usage();
+
+    const char*     output      = argv[1];
+    fs::path        input       = argv[2];
+    std::uint32_t   alignment   = 64;
+    const char*     order_path  = nullptr;
+
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--align" && i + 1 < argc) alignment = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--order" && i + 1 < argc) order_path = argv[++i];
+        else return usage();
+    }
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        std::cerr << "alignment must be a power of two\n";
+        return 2;
+    }
+
+    //sorted by name so the same input always produces the same pack
+    std::map<std::string, source> sources;
+
+    lotus::pack_reader input_pack;
+    std::error_code ec;
+
+    if (fs::is_regular_file(input, ec)) {
+        if (!input_pack.open(input.string().c_str())) {
+            std::cerr << "can't open pack " << input << "\n";
+            return 1;
+        }
+
+        for (std::size_t i = 0; i < input_pack.count(); i++) {
+            auto name = input_pack.name(i);
+            input_pack.find(name.c_str(), sources[name].blob);
+        }
+    }
+    else {
+        for (auto& entry : fs::recursive_directory_iterator(input, ec)) {
+            if (entry.is_regular_file()) sources[fs::relative(entry.path(), input).generic_string()].path = entry.path();
+        }
+        if (ec) {
+            std::cerr << "can't read " << input << ": " << ec.message() << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<std::string> order;
+    if (order_path) {
+        lotus::recording recording;
+        if (!lotus::load_recording(order_path, recording)) {
+            std::cerr << "can't read recording " << order_path << "\n";
+            return 1;
+        }
+
+        for (auto& name : lotus::first_use_order(recording)) {
+            if (sources.count(name)) order.push_back(name);
+        }
+    }
+
+    std::size_t ordered = order.size();
+    std::unordered_set<std::string> listed(order.begin(), order.end());
+    for (auto& s : sources) {
+        if (!listed.count(s.first)) order.push_back(s.first);
+    }
+
+    //the pack is written next to the output and renamed over it once complete, so the output may be the input
+    //pack, which stays mapped until the end, and a failed run leaves the previous pack in place
+    auto temp = std::string(output) + ".tmp";
+    std::unique_ptr<lotus::pack_writer> writer(new lotus::pack_writer(temp.c_str(), alignment));
+
+    auto discard = [&](const std::string& message) {
+        writer.reset();
+        fs::remove(temp, ec);
+        std::cerr << message << "\n";
+        return 1;
+    };
+
+    if (!writer->good()) return discard("can't open " + temp);
+
+    std::vector<char> bytes;
+    for (auto& name : order) {
+        auto& src = sources[name];
+        const void* data = src.blob.data;
+        std::size_t size = src.blob.size;
+
+        if (!data) {
+            std::ifstream file(src.path, std::ios::binary | std::ios::ate);
+            auto end = file ? static_cast<std::streamoff>(file.tellg()) : -1;
+
+            if (end >= 0) {
+                bytes.resize(static_cast<std::size_t>(end));
+                file.seekg(0);
+            }
+            if (end < 0 || !file.read(bytes.data(), bytes.size())) return discard("can't read " + src.path.string());
+
+            data = bytes.data();
+            size = bytes.size();
+        }
+
+        if (!writer->add(name.c_str(), data, size)) return discard("can't write " + temp);
+    }
+
+    if (!writer->finish()) return discard("can't write " + temp);
+
+    fs::rename(temp, output, ec);
+    if (ec) return discard("can't replace " + std::string(output) + ": " + ec.message());
+
+    std::cout << "packed " << order.size() << " resources into " << output;
+    if (order_path) std::cout << " (" << ordered << " in first-use order)";
+    std::cout << "\n";
+    return 0;
+}
@@ -0,0 +1,269 @@
+// lotus_replay - re-drives a recorded workload (see lotus/recorder.hpp) against a registry, printed as json
+//
+// usage: lotus_replay <recording.ltr> [options]
+//   --speed <x>         1 replays with recorded timing, 2 twice as fast, 0 as fast as possible (1)
+//   --serial            replays all threads' events on one thread in recorded order, fully deterministic
+//   --latency-us <us>   stand-in load latency (100)
+//   --size <bytes>      stand-in resource size (4096)
+//   --loaders <n>       asynchronous loader threads; 0 loads inside "get" (0)
+//   --policy <name>     registry policy: multi_threaded, flat (spin lock, hashed keys, flat index) or
+//                       single_threaded, which implies --serial and loads inside "get" (multi_threaded)
+//   --budget <bytes>    resident budget keeping released resources loaded; 0 unloads them right away (0)
+//
+// every recorded thread is replayed on its own thread; handles taken by replayed "get" calls are kept until
+// the recording shows the last handle of the resource expiring
+//
+// build: c++ -std=c++17 -O2 -DNDEBUG -Iinclude tools/lotus_replay.cpp -o lotus_replay -pthread
+
+#include <lotus/recorder.hpp>
+#include <lotus/stage_pool.hpp>
+
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+using resource   = std::vector<char>;
+using clock_type = std::chrono::steady_clock;
+
+//hashed keys in a flat index behind a spin lock
+using flat_policy = lotus::registry_policy<lotus::spin_mutex, lotus::hashed_keys, lotus::flat_index>;
+
+static double           speed       = 1;
+static bool             serial      = false;
+static unsigned int     latency_us  = 100;
+static std::size_t      size        = 4096;
+static unsigned int     loaders     = 0;
+static const char*      policy_name = "multi_threaded";
+static std::uint64_t    budget      = 0;
+
+static lotus::stage_pool* loader_pool = nullptr;
+
+//=================
+// Stand-in Loader
+
+template<class policy>
+static void stand_in_load(lotus::load_token<resource, policy> token) {
+    if (token.cancelled()) return lotus::abandon(token);
+
+    if (latency_us) std::this_thread::sleep_for(std::chrono::microseconds(latency_us));
+    lotus::complete(token, new resource(size), size);
+}
+
+template<class policy>
+static void load(const char*, lotus::resource_registry<resource, policy>&, lotus::load_token<resource, policy> token) {
+    if (loader_pool) loader_pool->push([token] { stand_in_load(token); });
+    else stand_in_load(token);
+}
+
+static void unload(resource* object) {
+    delete object;
+}
+
+//=================
+// Replay
+
+// handles held on behalf of the recorded program, per resource name
+template<class policy>
+struct held_handles {
+    using handle = lotus::resource_handle<resource, policy>;
+
+    static constexpr std::size_t stripes = 64;
+
+    std::mutex                          mutexes[stripes];
+    std::vector<std::vector<handle>>    handles;
+
+    held_handles(std::size_t names) : handles(names) {}
+
+    void add(std::uint32_t name, handle&& handle) {
+        std::lock_guard<std::mutex> lock(mutexes[name % stripes]);
+        handles[name].push_back(std::move(handle));
+    }
+
+    //handles are destroyed outside of the lock, as the last one unloads the resource
+    void release(std::uint32_t name) {
+        std::vector<handle> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutexes[name % stripes]);
+            dropped.swap(handles[name]);
+        }
+    }
+};
+
+struct replay_result {
+    std::vector<std::uint64_t>  get_latency;    //nanoseconds
+    std::uint64_t               events  = 0;
+    std::uint64_t               max_lag = 0;    //nanoseconds behind the recorded schedule
+};
+
+template<class policy>
+static void replay_events(
+    const lotus::recording&                     rec,
+    const std::vector<lotus::recorded_event>&   events,
+    lotus::resource_registry<resource, policy>& reg,
+    held_handles<policy>&                       held,
+    clock_type::time_point                      start,
+    replay_result&                              result
+) {
+    result.get_latency.reserve(events.size());
+
+    for (auto& e : events) {
+        if (speed > 0) {
+            auto due = start + std::chrono::nanoseconds(static_cast<std::uint64_t>(e.time / speed));
+            auto now = clock_type::now();
+
+            if (now < due) std::this_thread::sleep_until(due);
+            else result.max_lag = std::max<std::uint64_t>(result.max_lag, std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count());
+        }
+
+        auto name = e.name == lotus::recorded_event::no_name ? nullptr : rec.names[e.name].c_str();
+
+        switch (e.event) {
+        case lotus::registry_event::get: {
+            auto begin = clock_type::now();
+            auto handle = lotus::get(name, reg);
+            result.get_latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - begin).count());
+            held.add(e.name, std::move(handle));
+            break;
+        }
+        case lotus::registry_event::reg:
+            lotus::reg(name, new resource(size), reg);
+            break;
+        case lotus::registry_event::release:
+            held.release(e.name);
+            break;
+        case lotus::registry_event::reload_registry:
+            lotus::reload_registry(reg);
+            break;
+        case lotus::registry_event::unload_registry:
+            lotus::unload_registry(reg);
+            break;
+        case lotus::registry_event::reload:
+            lotus::reload(name, reg);
+            break;
+        case lotus::registry_event::refresh:
+            lotus::refresh(name, reg);
+            break;
+        }
+
+        result.events++;
+    }
+}
+
+//runs the recording against a registry with the given policy and prints the results
+template<class policy>
+static void replay(const lotus::recording& rec) {
+    std::unique_ptr<lotus::stage_pool> pool;
+    if (loaders) {
+        pool.reset(new lotus::stage_pool(loaders, 4096));
+        loader_pool = pool.get();
+    }
+
+    lotus::resource_registry<resource, policy> reg(load<policy>, unload);
+    if (budget) lotus::set_resident_budget(reg, budget);
+
+    held_handles<policy> held(rec.names.size());
+    std::vector<replay_result> results(rec.threads.size());
+
+    auto start = clock_type::now();
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < rec.threads.size(); t++)
+        threads.emplace_back([&, t] { replay_events(rec, rec.threads[t].events, reg, held, start, results[t]); });
+    for (auto& t : threads) t.join();
+    double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+    std::vector<std::uint64_t> latencies;
+    std::uint64_t events = 0, max_lag = 0;
+    for (auto& r : results) {
+        latencies.insert(latencies.end(), r.get_latency.begin(), r.get_latency.end());
+        events += r.events;
+        max_lag = std::max(max_lag, r.max_lag);
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    auto percentile = [&](double q) -> unsigned long long {
+        if (latencies.empty()) return 0;
+        return latencies[std::min(latencies.size() - 1, static_cast<std::size_t>(q * latencies.size()))];
+    };
+
+    using S = lotus::registry_stats;
+    auto s = lotus::stats(reg);
+
+    std::printf("{\n");
+    std::printf("  \"policy\": \"%s\", \"budget\": %llu,\n", policy_name, (unsigned long long)budget);
+    std::printf("  \"threads\": %zu, \"names\": %zu, \"events\": %llu, \"seconds\": %.3f, \"events_per_second\": %.1f,\n",
+        rec.threads.size(), rec.names.size(), (unsigned long long)events, elapsed, events / elapsed);
+    std::printf("  \"max_lag_ns\": %llu,\n", (unsigned long long)max_lag);
+    std::printf("  \"get_ns\": {\"count\": %zu, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu},\n",
+        latencies.size(), percentile(0.5), percentile(0.99), percentile(0.999));
+    std::printf("  \"hits\": %llu, \"misses\": %llu, \"loads\": %llu, \"unloads\": %llu, \"cancellations\": %llu\n",
+        (unsigned long long)s.counters[S::hits], (unsigned long long)s.counters[S::misses],
+        (unsigned long long)s.counters[S::loads], (unsigned long long)s.counters[S::unloads],
+        (unsigned long long)s.counters[S::cancellations]);
+    std::printf("}\n");
+
+    //leftover handles expire before the loader pool, which may still complete loads
+    held.handles.clear();
+    pool.reset();
+}
+
+//=================
+// Main
+
+static int usage() {
+    std::fprintf(stderr, "usage: lotus_replay <recording.ltr> [--speed <x>] [--serial] [--latency-us <us>] [--size <bytes>] [--loaders <n>]\n"
+        "                    [--policy <multi_threaded|flat|single_threaded>] [--budget <bytes>]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return usage();
+
+    for (int i = 2; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--serial")) serial = true;
+        else if (i + 1 >= argc) return usage();
+        else if (!std::strcmp(argv[i], "--speed"))      speed      = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--latency-us")) latency_us = static_cast<unsigned int>(std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--size"))       size       = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--loaders"))    loaders    = static_cast<unsigned int>(std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--policy"))     policy_name = argv[++i];
+        else if (!std::strcmp(argv[i], "--budget"))     budget     = std::strtoull(argv[++i], nullptr, 10);
+        else return usage();
+    }
+
+    bool single = !std::strcmp(policy_name, "single_threaded");
+    if (!single && std::strcmp(policy_name, "multi_threaded") && std::strcmp(policy_name, "flat")) return usage();
+
+    //a single threaded registry is only touched by the replaying thread
+    if (single) {
+        if (loaders) {
+            std::fprintf(stderr, "single_threaded registries load inside \"get\"; drop --loaders\n");
+            return 2;
+        }
+        serial = true;
+    }
+
+    lotus::recording rec;
+    if (!lotus::load_recording(argv[1], rec)) {
+        std::fprintf(stderr, "can't read recording %s\n", argv[1]);
+        return 1;
+    }
+
+    //serial replay merges the threads; events with equal times keep the order of their threads
+    if (serial && rec.threads.size() > 1) {
+        lotus::recorded_thread merged{0, {}};
+        for (auto& t : rec.threads) merged.events.insert(merged.events.end(), t.events.begin(), t.events.end());
+        std::stable_sort(merged.events.begin(), merged.events.end(), [](const lotus::recorded_event& a, const lotus::recorded_event& b) {
+            return a.time < b.time;
+        });
+
+        rec.threads.clear();
+        rec.threads.push_back(std::move(merged));
+    }
+
+    if (single) replay<lotus::single_threaded>(rec);
+    else if (!std::strcmp(policy_name, "flat")) replay<flat_policy>(rec);
+    else replay<lotus::multi_threaded>(rec);
+    return 0;
+}